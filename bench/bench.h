@@ -0,0 +1,69 @@
+/***************************************************************
+ * Benchmark markers shared by the benchmark firmware (compiled
+ * with avr-gcc) and the simavr-based benchmark runner (compiled
+ * for the host).
+ *
+ * The firmware writes an operation identifier to GPIOR1 when an
+ * operation begins and to GPIOR2 when it ends. The runner records
+ * the simulated cycle count at each write and the bytes seen on 
+ * the SPI, USART and TWI buses in between.
+ *
+ * @author Carl Harris
+ ***************************************************************/
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#define BENCH_OPS(X) \
+    X(BENCH_EMPTY,              "empty") \
+    X(BENCH_SPI_TRANSFER,       "spi_transfer") \
+    X(BENCH_MAX7221_WRITE,      "max7221_write") \
+    X(BENCH_MAX7221_UINT32,     "max7221_display_uint32") \
+    X(BENCH_MAX7221_UDEC,       "max7221_display_udec") \
+    X(BENCH_MAX7221_CHAIN_UINT32, "max7221_chain_display_uint32") \
+    X(BENCH_SERIAL_PUTC,        "serial_putc") \
+    X(BENCH_SERIAL_PUTS,        "serial_puts") \
+    X(BENCH_SERIAL_RX,          "serial_getc_16") \
+    X(BENCH_LCD_INIT,           "lcd_init") \
+    X(BENCH_LCD_PUTS,           "lcd_puts_16") \
+    X(BENCH_LCD_PUTS_595,       "lcd_puts_16_595") \
+    X(BENCH_LCD_595_PUTS,       "lcd_595_puts_16") \
+    X(BENCH_TWI_OUT,            "twi_master_out") \
+    X(BENCH_TWI_OUT_IRQ,        "twi_master_out_irq") \
+    X(BENCH_TWI_TRANSFER,       "twi_master_transfer_8") \
+    X(BENCH_TWI_SUBMIT_TICKS,   "twi_master_submit_ticks") \
+    X(BENCH_LCD_PUTS_TWI,       "lcd_puts_16_twi")
+
+#define BENCH_ENUM(id, name) id,
+enum {
+    BENCH_OPS(BENCH_ENUM)
+    BENCH_OP_COUNT
+};
+#undef BENCH_ENUM
+
+#ifdef __AVR__
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+
+#ifndef BENCH_REPEAT
+#define BENCH_REPEAT 4
+#endif
+
+#define BENCH_BEGIN(op)   (GPIOR1 = (op))
+#define BENCH_END(op)     (GPIOR2 = (op))
+
+/* runs a statement BENCH_REPEAT times, marking each run */
+#define BENCH(op, stmt) \
+    for (uint8_t bench_i = 0; bench_i < BENCH_REPEAT; bench_i++) { \
+        BENCH_BEGIN(op); \
+        stmt; \
+        BENCH_END(op); \
+    }
+
+/* sleeping with interrupts disabled ends the simulation */
+#define BENCH_EXIT() \
+    { cli(); sleep_enable(); sleep_cpu(); }
+#endif /* __AVR__ */
+
+#endif /* BENCH_H */
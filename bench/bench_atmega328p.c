@@ -0,0 +1,86 @@
+/***************************************************************
+ * Benchmark firmware for the ATmega328P. Exercises the spi,
+ * max7221, usart_serial, lcd (with its 74HC595 transport) and
+ * (hardware TWI) usi_twi_master modules, marking each operation
+ * for the benchmark runner.
+ *
+ * @author Carl Harris
+ ***************************************************************/
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "bench.h"
+#include "lcd.h"
+#include "lcd_595.h"
+#include "max7221.h"
+#include "serial.h"
+#include "spi.h"
+#include "usi_twi_master.h"
+
+#define LCD_ADDRESS   0x27
+#define CHAIN_LENGTH  4
+
+static int lcd_null_write(uint8_t ctx, uint8_t r) {
+  (void) ctx;
+  (void) r;
+  return 0;
+}
+
+int main(void) {
+  BENCH(BENCH_EMPTY, );
+
+  spi_init();
+  spi_enable();
+  BENCH(BENCH_SPI_TRANSFER, spi_transfer(0x55));
+
+  max7221_init();
+  BENCH(BENCH_MAX7221_WRITE, max7221_write(0x01, 0x55));
+  BENCH(BENCH_MAX7221_UINT32, max7221_display_uint32(0x12345678));
+  BENCH(BENCH_MAX7221_UDEC, max7221_display_udec(12345678, true));
+
+  uint32_t values[CHAIN_LENGTH] = { 0x0, 0x1, 0x2, 0x3 };
+  BENCH(BENCH_MAX7221_CHAIN_UINT32,
+      max7221_chain_display_uint32(CHAIN_LENGTH, values));
+
+  serial_init();
+  BENCH(BENCH_SERIAL_PUTC, serial_putc('x'));
+  BENCH(BENCH_SERIAL_PUTS, serial_puts("Hello, world.\n"));
+
+  LCD lcd;
+  lcd.write = lcd_null_write;
+  lcd.ctx = 0;
+  BENCH(BENCH_LCD_INIT, lcd_init(&lcd));
+  BENCH(BENCH_LCD_PUTS, lcd_puts(&lcd, "0123456789abcdef"));
+
+  lcd_595_init();
+  lcd.write = lcd_595_write;
+  BENCH(BENCH_LCD_PUTS_595, lcd_puts(&lcd, "0123456789abcdef"));
+  BENCH(BENCH_LCD_595_PUTS, lcd_595_puts(&lcd, "0123456789abcdef"));
+
+  twi_master_init();
+  BENCH(BENCH_TWI_OUT, twi_master_out(LCD_ADDRESS, 0x55));
+
+  uint8_t buf[9] = { LCD_ADDRESS << 1, 1, 2, 3, 4, 5, 6, 7, 8 };
+  BENCH(BENCH_TWI_TRANSFER, twi_master_transfer(buf, sizeof(buf)));
+
+  lcd.write = twi_master_out;
+  lcd.ctx = LCD_ADDRESS;
+  BENCH(BENCH_LCD_PUTS_TWI, lcd_puts(&lcd, "0123456789abcdef"));
+
+  sei();
+  BENCH(BENCH_TWI_OUT_IRQ, twi_master_out(LCD_ADDRESS, 0x55));
+
+  // the runner sends 16 bytes when this operation begins
+  BENCH(BENCH_SERIAL_RX, {
+    uint8_t n = 0;
+    while (n < 16) {
+      if (serial_getc() != -1) {
+        n++;
+      }
+    }
+  });
+
+  BENCH_EXIT();
+  return 0;
+}
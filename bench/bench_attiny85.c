@@ -0,0 +1,52 @@
+/***************************************************************
+ * Benchmark firmware for the ATtiny85. Exercises the lcd module
+ * with a callback that does no I/O, and runs the timer interrupt
+ * of usi_twi_master_async.
+ *
+ * simavr does not model the USI, so an interrupt-driven transfer
+ * never gets past its address byte: the timer interrupt runs its
+ * start and clock strobe paths, which the runner reports as the
+ * isr_cycles of the Timer/Counter0 compare match vector. Otherwise
+ * the usi_twi_master and usi_twi_slave modules are measured for
+ * footprint only.
+ *
+ * @author Carl Harris
+ ***************************************************************/
+
+#include <stdint.h>
+#include <util/delay.h>
+
+#include "bench.h"
+#include "lcd.h"
+#include "usi_twi_master.h"
+
+static int lcd_null_write(uint8_t ctx, uint8_t r) {
+  (void) ctx;
+  (void) r;
+  return 0;
+}
+
+int main(void) {
+  BENCH(BENCH_EMPTY, );
+
+  LCD lcd;
+  lcd.write = lcd_null_write;
+  lcd.ctx = 0;
+  BENCH(BENCH_LCD_INIT, lcd_init(&lcd));
+  BENCH(BENCH_LCD_PUTS, lcd_puts(&lcd, "0123456789abcdef"));
+
+  // only the first submit starts a transfer, which then strobes SCL
+  // until the timer is stopped
+  uint8_t buf[2] = { 0x27 << 1, 0x55 };
+  TWIRequest request = { buf, sizeof(buf), NULL, TWI_PENDING };
+  twi_master_init();
+  sei();
+  BENCH(BENCH_TWI_SUBMIT_TICKS, {
+    twi_master_submit(&request);
+    _delay_ms(1);
+  });
+  TIMSK = 0;
+
+  BENCH_EXIT();
+  return 0;
+}
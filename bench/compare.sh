@@ -0,0 +1,52 @@
+#!/bin/sh
+#
+# Compares benchmark results with a baseline.
+#
+# Usage: compare.sh <baseline> <results> [tolerance-percent]
+#
+# Each line of both files has the form "<mcu> <subject> <metric> <value>".
+# Metrics are costs (cycles, bytes), so a value that is more than the
+# tolerance above the baseline is reported as a regression, except for
+# rates (metrics named *_per_s), which regress when they fall below
+# the baseline by more than the tolerance. Exits with a non-zero status
+# if there are any regressions.
+
+if [ $# -lt 2 ]; then
+  echo "usage: $0 <baseline> <results> [tolerance-percent]" >&2
+  exit 2
+fi
+
+if [ ! -f "$1" ]; then
+  echo "$1: no baseline; run 'make baseline' first" >&2
+  exit 2
+fi
+
+awk -v tol="${3:-2}" '
+  NR == FNR { base[$1 " " $2 " " $3] = $4; next }
+  {
+    key = $1 " " $2 " " $3
+    if (!(key in base)) {
+      printf "new        %-50s %10d\n", key, $4
+      next
+    }
+    old = base[key]
+    rate = ($3 ~ /_per_s$/)
+    if ($4 > old * (1 + tol / 100.0)) {
+      worse = !rate
+    }
+    else if ($4 < old * (1 - tol / 100.0)) {
+      worse = rate
+    }
+    else {
+      next
+    }
+    if (worse) {
+      printf "REGRESSED  %-50s %10d -> %d\n", key, old, $4
+      failed = 1
+    }
+    else {
+      printf "improved   %-50s %10d -> %d\n", key, old, $4
+    }
+  }
+  END { exit failed }
+' "$1" "$2"
@@ -0,0 +1,490 @@
+/***************************************************************
+ * Host-native functional and throughput benchmarks. Runs the
+ * library modules against the peripheral and device models in
+ * host/, reporting for each API call the time it takes on the
+ * virtual clock and the bus traffic it generates, and checking
+ * that the modelled displays and peers show what was sent.
+ *
+ * Results are printed in the same form as the simavr benchmarks:
+ *     host <subject> <metric> <value>
+ * When built for the ATmega328P (with the TWI registers, rather than
+ * those of the USI), only the hardware TWI backend is benchmarked and
+ * the first field is BENCH_HOST, e.g. host_atmega328p.
+ * Failed checks are reported on stderr, and make the program exit
+ * with a non-zero status.
+ *
+ * @author Carl Harris
+ ***************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <avr/interrupt.h>
+
+#include "sim.h"
+#include "hc595_model.h"
+#include "hd44780_model.h"
+#include "max7221_model.h"
+#include "pcf8574_model.h"
+#include "uart_peer.h"
+
+#include "lcd.h"
+#include "lcd_595.h"
+#include "max7221.h"
+#include "serial.h"
+#include "spi.h"
+#include "usi_twi_master.h"
+
+#ifndef BENCH_HOST
+#define BENCH_HOST        "host"
+#endif
+
+#define LCD_ADDRESS       0x27
+#define CHAIN_LENGTH      4
+#define MAX7221_CS_PORT   SIM_PORTD
+#define MAX7221_CS_MASK   (1 << PD2)
+#define LCD_595_LATCH_PORT  SIM_PORTB
+#define LCD_595_LATCH_MASK  (1 << PB1)
+
+static int failures;
+
+typedef struct {
+    uint64_t time;
+    SimCounters counts;
+} Mark;
+
+static Mark mark(void) {
+  Mark m;
+  m.time = sim_time_ns();
+  m.counts = *sim_counters();
+  return m;
+}
+
+static void report(const char* subject, const Mark* start) {
+  Mark end = mark();
+  printf(BENCH_HOST " %s ns %llu\n", subject,
+      (unsigned long long) (end.time - start->time));
+  if (end.counts.spi_bytes != start->counts.spi_bytes) {
+    printf(BENCH_HOST " %s spi_bytes %lu\n", subject,
+        (unsigned long) (end.counts.spi_bytes - start->counts.spi_bytes));
+  }
+  if (end.counts.uart_tx_bytes != start->counts.uart_tx_bytes) {
+    printf(BENCH_HOST " %s uart_bytes %lu\n", subject,
+        (unsigned long) (end.counts.uart_tx_bytes - start->counts.uart_tx_bytes));
+  }
+  if (end.counts.uart_rx_bytes != start->counts.uart_rx_bytes) {
+    printf(BENCH_HOST " %s uart_rx_bytes %lu\n", subject,
+        (unsigned long) (end.counts.uart_rx_bytes - start->counts.uart_rx_bytes));
+  }
+  if (end.counts.twi_bytes != start->counts.twi_bytes) {
+    printf(BENCH_HOST " %s twi_starts %lu\n", subject,
+        (unsigned long) (end.counts.twi_starts - start->counts.twi_starts));
+    printf(BENCH_HOST " %s twi_bytes %lu\n", subject,
+        (unsigned long) (end.counts.twi_bytes - start->counts.twi_bytes));
+  }
+  if (end.counts.interrupts != start->counts.interrupts) {
+    printf(BENCH_HOST " %s interrupts %lu\n", subject,
+        (unsigned long) (end.counts.interrupts - start->counts.interrupts));
+  }
+  if (end.counts.errors != start->counts.errors) {
+    fprintf(stderr, BENCH_HOST " %s: simulation reported errors\n", subject);
+    failures++;
+  }
+}
+
+/* runs a statement, reporting its cost under the given subject */
+#define MEASURE(subject, stmt) { \
+    Mark start = mark(); \
+    stmt; \
+    report(subject, &start); \
+}
+
+/* reports the rate at which a statement writes the given characters */
+static void report_chars(const char* subject, const Mark* start,
+    unsigned long chars) {
+  uint64_t ns = sim_time_ns() - start->time;
+  printf(BENCH_HOST " %s chars_per_s %lu\n", subject,
+      (unsigned long) (chars * 1000000000ULL / ns));
+}
+
+/* measures a statement that writes characters to a display */
+#define MEASURE_CHARS(subject, chars, stmt) { \
+    Mark start = mark(); \
+    stmt; \
+    report_chars(subject, &start, chars); \
+    report(subject, &start); \
+}
+
+static void expect(const char* subject, const char* expected,
+    const char* actual) {
+  if (strcmp(expected, actual) != 0) {
+    fprintf(stderr, BENCH_HOST " %s: expected \"%s\", got \"%s\"\n",
+        subject, expected, actual);
+    failures++;
+  }
+}
+
+static void expect_count(const char* subject, const char* what,
+    unsigned long expected, unsigned long actual) {
+  if (expected != actual) {
+    fprintf(stderr, BENCH_HOST " %s: expected %lu %s, got %lu\n",
+        subject, expected, what, actual);
+    failures++;
+  }
+}
+
+#ifndef TWCR
+static void bench_spi(void) {
+  sim_reset();
+  spi_init();
+  spi_enable();
+  MEASURE("spi_transfer", spi_transfer(0x55));
+}
+
+static void bench_max7221(void) {
+  MAX7221Model model;
+  char text[17];
+
+  sim_reset();
+  max7221_model_init(&model, MAX7221_CS_PORT, MAX7221_CS_MASK, 1);
+  spi_init();
+  spi_enable();
+  max7221_init();
+  max7221_config();
+
+  MEASURE("max7221_write", max7221_write(0x01, 0x30));
+  MEASURE("max7221_display_uint32", max7221_display_uint32(0x1234abcd));
+  expect("max7221_display_uint32", "1234AbCd",
+      max7221_model_text(&model, 0, text));
+
+  MEASURE("max7221_display_udec", max7221_display_udec(12345678, true));
+  expect("max7221_display_udec", "12345678",
+      max7221_model_text(&model, 0, text));
+
+  MEASURE("max7221_display_fixed", max7221_display_fixed(-1234, 2, true));
+  expect("max7221_display_fixed", "   -12.34",
+      max7221_model_text(&model, 0, text));
+
+  // the sign and a units digit leave room for at most six places
+  max7221_display_fixed(-5, 7, true);
+  expect("max7221_display_fixed", "--------",
+      max7221_model_text(&model, 0, text));
+
+  sim_reset();
+  max7221_model_init(&model, MAX7221_CS_PORT, MAX7221_CS_MASK, CHAIN_LENGTH);
+  spi_init();
+  spi_enable();
+  max7221_init();
+  max7221_chain_write(CHAIN_LENGTH, 0x0B, 0x07);
+  max7221_chain_write(CHAIN_LENGTH, 0x0C, 0x01);
+
+  uint32_t values[CHAIN_LENGTH] = { 0x0, 0x11111111, 0x22222222, 0x33333333 };
+  MEASURE("max7221_chain_display_uint32",
+      max7221_chain_display_uint32(CHAIN_LENGTH, values));
+  expect("max7221_chain_display_uint32", "00000000",
+      max7221_model_text(&model, 0, text));
+  expect("max7221_chain_display_uint32", "33333333",
+      max7221_model_text(&model, 3, text));
+}
+
+static void bench_serial(void) {
+  UARTPeer peer;
+
+  sim_reset();
+  uart_peer_init(&peer);
+  serial_init();
+
+  MEASURE("serial_putc", serial_putc('x'));
+  MEASURE("serial_puts", serial_puts("Hello, world.\n"));
+  sim_delay_us(1000);           // let the last frame finish
+  expect("serial_puts", "xHello, world.\n", uart_peer_received(&peer));
+}
+
+/*
+ * Reads characters from the serial port into a buffer, spending the
+ * given time on each group of characters read. Gives up if no
+ * character arrives for 10 ms.
+ */
+static void serial_read(char* buf, uint16_t length, uint8_t group,
+    uint16_t group_us) {
+  uint16_t n = 0;
+  uint16_t idle_us = 0;
+  while (n < length && idle_us < 10000) {
+    int c = serial_getc();
+    if (c < 0) {
+      sim_delay_us(10);         // poll again shortly
+      idle_us += 10;
+      continue;
+    }
+    idle_us = 0;
+    buf[n++] = c;
+    if (n % group == 0) {
+      sim_delay_us(group_us);
+    }
+  }
+  buf[n] = 0;
+}
+
+static void bench_serial_rx(void) {
+  static const char BURST[] = "0123456789abcdef";
+  UARTPeer peer;
+  char text[241];
+
+  sim_reset();
+  uart_peer_init(&peer);
+  serial_init();
+  sei();
+
+  uart_peer_send(&peer, BURST);
+  MEASURE("serial_getc_16", serial_read(text, 16, 16, 0));
+  expect("serial_getc_16", BURST, text);
+
+  // a reader that is busy for about 11 frame times after every 16
+  // characters relies on the receive ring to hold the backlog
+  char expected[241];
+  for (uint16_t i = 0; i < 240; i++) {
+    expected[i] = ' ' + i % 95;
+  }
+  expected[240] = 0;
+  uart_peer_send(&peer, expected);
+  MEASURE("serial_getc_240", serial_read(text, 240, 16, 3000));
+  expect("serial_getc_240", expected, text);
+  cli();
+}
+
+#endif /* TWCR */
+
+static void check_lcd(const char* subject, HD44780Model* model,
+    const char* row0, const char* row1) {
+  char line[41];
+  expect(subject, row0, hd44780_model_line(model, 0, line));
+  expect(subject, row1, hd44780_model_line(model, 1, line));
+  expect_count(subject, "busy violations", 0, model->violations);
+}
+
+#ifndef TWCR
+static void bench_lcd(void) {
+  HD44780Model model;
+  LCD lcd;
+
+  sim_reset();
+  hd44780_model_init(&model, 16, 2);
+  hd44780_model_target = &model;
+  lcd.write = hd44780_model_lcd_write;
+  lcd.ctx = 0;
+
+  MEASURE("lcd_init", lcd_init(&lcd));
+  MEASURE_CHARS("lcd_puts_16", 16, lcd_puts(&lcd, "0123456789abcdef"));
+  MEASURE("lcd_goto", lcd_goto(&lcd, 4, 1));
+  lcd_puts(&lcd, "world");
+  check_lcd("lcd_puts_16", &model, "0123456789abcdef", "    world       ");
+
+  static const uint8_t SMILEY[8] = { 0, 10, 10, 0, 17, 14, 0, 0 };
+  MEASURE("lcd_cg_write", lcd_cg_write(&lcd, 1, SMILEY));
+  expect_count("lcd_cg_write", "CGRAM mismatches", 0,
+      memcmp(&model.cgram[8], SMILEY, sizeof(SMILEY)) != 0);
+
+  MEASURE("lcd_clear", lcd_clear(&lcd));
+  check_lcd("lcd_clear", &model, "                ", "                ");
+}
+
+#endif /* TWCR */
+
+static void lcd_pins(void* ctx, uint8_t output) {
+  hd44780_model_write(ctx, output);
+}
+
+static void bench_lcd_twi(void) {
+  HD44780Model model;
+  PCF8574Model expander;
+  LCD lcd;
+
+  sim_reset();
+  hd44780_model_init(&model, 16, 2);
+  pcf8574_model_init(&expander, LCD_ADDRESS, NULL, NULL);
+  twi_master_init();
+
+  // an empty list of messages leaves the bus alone
+  expect_count("twi_master_messages", "status", TWI_OK,
+      twi_master_messages(NULL, 0));
+  expect_count("twi_master_messages", "starts", 0, sim_counters()->twi_starts);
+
+  MEASURE("twi_master_out", twi_master_out(LCD_ADDRESS, 0xFF));
+  expect_count("twi_master_out", "expander writes", 1, expander.writes);
+
+  uint8_t port;
+  expander.input = 0xA5;
+  MEASURE("twi_master_write_read",
+      twi_master_write_read(LCD_ADDRESS, NULL, 0, &port, 1));
+  expect_count("twi_master_write_read", "port value", 0xA5, port);
+
+  // connect the LCD to the expander
+  expander.changed = lcd_pins;
+  expander.ctx = &model;
+  lcd.write = twi_master_out;
+  lcd.ctx = LCD_ADDRESS;
+  MEASURE("lcd_init_twi", lcd_init(&lcd));
+  MEASURE_CHARS("lcd_puts_16_twi", 16,
+      lcd_puts(&lcd, "0123456789abcdef"));
+  lcd_goto(&lcd, 0, 1);
+  lcd_puts(&lcd, "over I2C");
+  check_lcd("lcd_puts_16_twi", &model, "0123456789abcdef", "over I2C        ");
+}
+
+/* waits for an interrupt-driven transfer to complete */
+static void twi_wait(void) {
+  while (twi_master_busy()) {
+    sim_delay_us(1);
+  }
+}
+
+static uint8_t twi_completions;
+static TWIStatus twi_completed_status;
+
+static void twi_completed(TWIRequest* request) {
+  twi_completions++;
+  twi_completed_status = request->status;
+}
+
+static void bench_twi_async(void) {
+  PCF8574Model expander;
+
+  sim_reset();
+  pcf8574_model_init(&expander, LCD_ADDRESS, NULL, NULL);
+  twi_master_init();
+  sei();
+
+  // bit 6 of the last byte is left in USIDR after its acknowledge,
+  // where a zero would hold SDA low through the stop condition
+  uint8_t first[2] = { LCD_ADDRESS << 1, 0x08 };
+  TWIRequest request = { first, sizeof(first), twi_completed, TWI_PENDING };
+  twi_completions = 0;
+  MEASURE("twi_master_submit", {
+    twi_master_submit(&request);
+    twi_wait();
+  });
+  expect_count("twi_master_submit", "status", TWI_OK, request.status);
+  expect_count("twi_master_submit", "port value", 0x08, expander.output);
+  expect_count("twi_master_submit", "callbacks", 1, twi_completions);
+  expect_count("twi_master_submit", "callback status", TWI_OK,
+      twi_completed_status);
+
+  uint8_t second[2] = { LCD_ADDRESS << 1, 0xA5 };
+  request.data = second;
+  twi_master_submit(&request);
+  twi_wait();
+  expect_count("twi_master_submit", "status", TWI_OK, request.status);
+  expect_count("twi_master_submit", "expander writes", 2, expander.writes);
+  expect_count("twi_master_submit", "port value", 0xA5, expander.output);
+
+#ifdef USIDR
+  // a slave that holds SCL low makes the transfer time out
+  sim_i2c_hold_scl(true);
+  twi_master_submit(&request);
+  twi_wait();
+  sim_i2c_hold_scl(false);
+  expect_count("twi_master_submit", "status", TWI_TIMEOUT, request.status);
+  expect_count("twi_master_submit", "callbacks", 3, twi_completions);
+  expect_count("twi_master_recover", "status", TWI_OK, twi_master_recover());
+
+  twi_master_submit(&request);
+  twi_wait();
+  expect_count("twi_master_submit", "status", TWI_OK, request.status);
+  expect_count("twi_master_submit", "expander writes", 3, expander.writes);
+#endif
+  cli();
+}
+
+#ifdef TWCR
+static void bench_twi_timeout(void) {
+  PCF8574Model expander;
+  uint8_t port;
+
+  sim_reset();
+  pcf8574_model_init(&expander, LCD_ADDRESS, NULL, NULL);
+  twi_master_init();
+
+  // a slave that holds SCL low stops the stop condition that ends
+  // this transfer from completing
+  expect_count("twi_master_out", "result", 1,
+      twi_master_out(LCD_ADDRESS, 0x01));
+  sim_i2c_hold_scl(true);
+  expect_count("twi_master_write_read", "status", TWI_TIMEOUT,
+      twi_master_write_read(LCD_ADDRESS, NULL, 0, &port, 1));
+
+  // and the start condition of the next one, driven by the interrupt
+  sei();
+  expect_count("twi_master_write_read", "status", TWI_TIMEOUT,
+      twi_master_write_read(LCD_ADDRESS, NULL, 0, &port, 1));
+  cli();
+
+  sim_i2c_hold_scl(false);
+  expect_count("twi_master_out", "result", 1,
+      twi_master_out(LCD_ADDRESS, 0x02));
+  expect_count("twi_master_out", "expander writes", 2, expander.writes);
+  expect_count("twi_master_out", "port value", 0x02, expander.output);
+}
+#endif /* TWCR */
+
+#ifndef TWCR
+static void bench_lcd_595(void) {
+  HD44780Model model;
+  HC595Model shifter;
+  LCD lcd;
+
+  sim_reset();
+  hd44780_model_init(&model, 16, 2);
+  hc595_model_init(&shifter, LCD_595_LATCH_PORT, LCD_595_LATCH_MASK,
+      lcd_pins, &model);
+  spi_init();
+  spi_enable();
+  lcd_595_init();
+  lcd.write = lcd_595_write;
+  lcd.ctx = 0;
+
+  MEASURE("lcd_init_595", lcd_init(&lcd));
+  MEASURE_CHARS("lcd_puts_16_595", 16, lcd_puts(&lcd, "0123456789abcdef"));
+  lcd_goto(&lcd, 0, 1);
+  lcd_puts(&lcd, "over SPI");
+  check_lcd("lcd_puts_16_595", &model, "0123456789abcdef", "over SPI        ");
+
+  lcd_home(&lcd);
+  MEASURE_CHARS("lcd_595_puts_16", 16, lcd_595_puts(&lcd, "fedcba9876543210"));
+  check_lcd("lcd_595_puts_16", &model, "fedcba9876543210", "over SPI        ");
+
+  // a full-screen update, as a refresh loop would write it
+  static const char SCREEN[2][17] = { "Temp    21.5 C  ", "Humidity  48 %  " };
+  MEASURE_CHARS("lcd_595_screen", 32, {
+    for (uint8_t row = 0; row < 2; row++) {
+      lcd_595_goto(&lcd, 0, row);
+      lcd_595_write_data(&lcd, SCREEN[row], 16);
+    }
+  });
+  check_lcd("lcd_595_screen", &model, SCREEN[0], SCREEN[1]);
+}
+
+#endif /* TWCR */
+
+int main(void) {
+#ifdef TWCR
+  bench_lcd_twi();
+  bench_twi_async();
+  bench_twi_timeout();
+#else
+  bench_spi();
+  bench_max7221();
+  bench_serial();
+  bench_serial_rx();
+  bench_lcd();
+  bench_lcd_twi();
+  bench_twi_async();
+  bench_lcd_595();
+#endif
+
+  if (failures != 0) {
+    fprintf(stderr, BENCH_HOST ": %d check(s) failed\n", failures);
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
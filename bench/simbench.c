@@ -0,0 +1,309 @@
+/***************************************************************
+ * Benchmark runner. Loads a benchmark firmware image into simavr
+ * and reports, for each marked operation, the CPU cycles taken
+ * and the bytes transferred on the SPI, USART and TWI buses, and
+ * for each interrupt vector, the entry latency and the cycles
+ * from entry to exit.
+ *
+ * Usage: simbench <mcu> <f_cpu> <firmware.elf>
+ *
+ * Each result is printed on a line of the form
+ *     <mcu> <subject> <metric> <value>
+ * so that results can be compared with a stored baseline.
+ *
+ * @author Carl Harris
+ ***************************************************************/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim_avr.h"
+#include "sim_elf.h"
+#include "sim_io.h"
+#include "sim_irq.h"
+#include "sim_interrupts.h"
+#include "avr_spi.h"
+#include "avr_twi.h"
+#include "avr_uart.h"
+
+#include "bench.h"
+
+#define MAX_VECTORS   32
+#define RX_BYTES      16
+
+typedef struct {
+    const char* mcu;
+    avr_io_addr_t begin_addr;     /* data space address of GPIOR1 */
+    avr_io_addr_t end_addr;       /* data space address of GPIOR2 */
+    uint8_t vectors;              /* number of interrupt vectors */
+} McuInfo;
+
+static const McuInfo MCUS[] = {
+    { "atmega328p", 0x4A, 0x4B, 26 },
+    { "attiny85",   0x32, 0x33, 15 },
+};
+
+#define BENCH_NAME(id, name) name,
+static const char* OP_NAMES[] = {
+    BENCH_OPS(BENCH_NAME)
+};
+
+typedef struct {
+    uint32_t count;
+    uint64_t total;
+    uint64_t min;
+    uint64_t max;
+} Stats;
+
+typedef struct {
+    Stats cycles;
+    uint64_t spi_bytes;
+    uint64_t uart_bytes;
+    uint64_t twi_bytes;
+    avr_cycle_count_t started;
+} OpStats;
+
+typedef struct {
+    Stats duration;               /* entry to exit (reti) */
+    Stats latency;                /* raised to entry */
+    avr_cycle_count_t raised;
+    avr_cycle_count_t entered;
+} VectorStats;
+
+static avr_t* avr;
+static OpStats ops[BENCH_OP_COUNT];
+static VectorStats vectors[MAX_VECTORS];
+static int current_op = -1;
+static uint64_t spi_bytes, uart_bytes, twi_bytes;
+static avr_irq_t* uart_input;
+static avr_irq_t* twi_input;
+
+static void stats_add(Stats* s, uint64_t value) {
+  if (s->count == 0 || value < s->min) {
+    s->min = value;
+  }
+  if (value > s->max) {
+    s->max = value;
+  }
+  s->total += value;
+  s->count++;
+}
+
+static void begin_hook(avr_t* a, avr_io_addr_t addr, uint8_t v, void* param) {
+  (void) addr;
+  (void) param;
+  if (v >= BENCH_OP_COUNT) {
+    return;
+  }
+  current_op = v;
+  ops[v].started = a->cycle;
+  ops[v].spi_bytes -= spi_bytes;
+  ops[v].uart_bytes -= uart_bytes;
+  ops[v].twi_bytes -= twi_bytes;
+
+  if (v == BENCH_SERIAL_RX && uart_input != NULL) {
+    for (int i = 0; i < RX_BYTES; i++) {
+      avr_raise_irq(uart_input, 'a' + i);
+    }
+  }
+}
+
+static void end_hook(avr_t* a, avr_io_addr_t addr, uint8_t v, void* param) {
+  (void) addr;
+  (void) param;
+  if (v >= BENCH_OP_COUNT || v != current_op) {
+    return;
+  }
+  stats_add(&ops[v].cycles, a->cycle - ops[v].started);
+  ops[v].spi_bytes += spi_bytes;
+  ops[v].uart_bytes += uart_bytes;
+  ops[v].twi_bytes += twi_bytes;
+  current_op = -1;
+}
+
+static void spi_hook(avr_irq_t* irq, uint32_t value, void* param) {
+  (void) irq;
+  (void) value;
+  (void) param;
+  spi_bytes++;
+}
+
+static void uart_hook(avr_irq_t* irq, uint32_t value, void* param) {
+  (void) irq;
+  (void) value;
+  (void) param;
+  uart_bytes++;
+}
+
+/*
+ * A TWI slave that acknowledges every address and byte, and returns
+ * 0xFF for every byte read.
+ */
+static void twi_hook(avr_irq_t* irq, uint32_t value, void* param) {
+  (void) irq;
+  (void) param;
+  avr_twi_msg_irq_t msg;
+  msg.u.v = value;
+
+  if (msg.u.twi.msg & (TWI_COND_ADDR | TWI_COND_WRITE)) {
+    twi_bytes++;
+    avr_raise_irq(twi_input,
+        avr_twi_irq_msg(TWI_COND_ACK, msg.u.twi.addr, 1));
+  }
+  if (msg.u.twi.msg & TWI_COND_READ) {
+    twi_bytes++;
+    avr_raise_irq(twi_input,
+        avr_twi_irq_msg(TWI_COND_READ, msg.u.twi.addr, 0xFF));
+  }
+}
+
+static void pending_hook(avr_irq_t* irq, uint32_t value, void* param) {
+  (void) irq;
+  VectorStats* vs = param;
+  if (value) {
+    vs->raised = avr->cycle;
+  }
+}
+
+static void running_hook(avr_irq_t* irq, uint32_t value, void* param) {
+  (void) irq;
+  VectorStats* vs = param;
+  if (value) {
+    vs->entered = avr->cycle;
+    stats_add(&vs->latency, avr->cycle - vs->raised);
+  }
+  else {
+    stats_add(&vs->duration, avr->cycle - vs->entered);
+  }
+}
+
+static void connect_buses(void) {
+  avr_irq_t* irq;
+
+  irq = avr_io_getirq(avr, AVR_IOCTL_SPI_GETIRQ(0), SPI_IRQ_OUTPUT);
+  if (irq) {
+    avr_irq_register_notify(irq, spi_hook, NULL);
+  }
+
+  irq = avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_OUTPUT);
+  if (irq) {
+    uint32_t flags = 0;
+    avr_ioctl(avr, AVR_IOCTL_UART_GET_FLAGS('0'), &flags);
+    flags &= ~AVR_UART_FLAG_STDIO;
+    avr_ioctl(avr, AVR_IOCTL_UART_SET_FLAGS('0'), &flags);
+    avr_irq_register_notify(irq, uart_hook, NULL);
+    uart_input = avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'),
+        UART_IRQ_INPUT);
+  }
+
+  irq = avr_io_getirq(avr, AVR_IOCTL_TWI_GETIRQ(0), TWI_IRQ_OUTPUT);
+  if (irq) {
+    avr_irq_register_notify(irq, twi_hook, NULL);
+    twi_input = avr_io_getirq(avr, AVR_IOCTL_TWI_GETIRQ(0), TWI_IRQ_INPUT);
+  }
+}
+
+static void connect_vectors(uint8_t count) {
+  for (uint8_t v = 1; v < count && v < MAX_VECTORS; v++) {
+    avr_irq_t* irq = avr_get_interrupt_irq(avr, v);
+    if (irq == NULL) {
+      continue;
+    }
+    avr_irq_register_notify(irq + AVR_INT_IRQ_PENDING, pending_hook,
+        &vectors[v]);
+    avr_irq_register_notify(irq + AVR_INT_IRQ_RUNNING, running_hook,
+        &vectors[v]);
+  }
+}
+
+static void report(const char* mcu) {
+  for (int i = 0; i < BENCH_OP_COUNT; i++) {
+    const OpStats* op = &ops[i];
+    if (op->cycles.count == 0) {
+      continue;
+    }
+    printf("%s %s cycles %llu\n", mcu, OP_NAMES[i],
+        (unsigned long long) (op->cycles.total / op->cycles.count));
+    printf("%s %s cycles_max %llu\n", mcu, OP_NAMES[i],
+        (unsigned long long) op->cycles.max);
+    if (op->spi_bytes) {
+      printf("%s %s spi_bytes %llu\n", mcu, OP_NAMES[i],
+          (unsigned long long) (op->spi_bytes / op->cycles.count));
+    }
+    if (op->uart_bytes) {
+      printf("%s %s uart_bytes %llu\n", mcu, OP_NAMES[i],
+          (unsigned long long) (op->uart_bytes / op->cycles.count));
+    }
+    if (op->twi_bytes) {
+      printf("%s %s twi_bytes %llu\n", mcu, OP_NAMES[i],
+          (unsigned long long) (op->twi_bytes / op->cycles.count));
+    }
+  }
+
+  for (int v = 0; v < MAX_VECTORS; v++) {
+    const VectorStats* vs = &vectors[v];
+    if (vs->duration.count == 0) {
+      continue;
+    }
+    printf("%s vector_%d isr_cycles %llu\n", mcu, v,
+        (unsigned long long) (vs->duration.total / vs->duration.count));
+    printf("%s vector_%d isr_cycles_max %llu\n", mcu, v,
+        (unsigned long long) vs->duration.max);
+    printf("%s vector_%d latency_max %llu\n", mcu, v,
+        (unsigned long long) vs->latency.max);
+  }
+}
+
+int main(int argc, char* argv[]) {
+  if (argc != 4) {
+    fprintf(stderr, "usage: %s <mcu> <f_cpu> <firmware.elf>\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  const McuInfo* info = NULL;
+  for (size_t i = 0; i < sizeof(MCUS) / sizeof(MCUS[0]); i++) {
+    if (strcmp(MCUS[i].mcu, argv[1]) == 0) {
+      info = &MCUS[i];
+    }
+  }
+  if (info == NULL) {
+    fprintf(stderr, "%s: unsupported mcu\n", argv[1]);
+    return EXIT_FAILURE;
+  }
+
+  elf_firmware_t firmware;
+  memset(&firmware, 0, sizeof(firmware));
+  if (elf_read_firmware(argv[3], &firmware) != 0) {
+    fprintf(stderr, "%s: cannot read firmware\n", argv[3]);
+    return EXIT_FAILURE;
+  }
+
+  avr = avr_make_mcu_by_name(info->mcu);
+  if (avr == NULL) {
+    fprintf(stderr, "%s: unknown to simavr\n", info->mcu);
+    return EXIT_FAILURE;
+  }
+  avr_init(avr);
+  avr->frequency = strtoul(argv[2], NULL, 10);
+  avr_load_firmware(avr, &firmware);
+
+  avr_register_io_write(avr, info->begin_addr, begin_hook, NULL);
+  avr_register_io_write(avr, info->end_addr, end_hook, NULL);
+  connect_buses();
+  connect_vectors(info->vectors);
+
+  int state;
+  do {
+    state = avr_run(avr);
+  } while (state != cpu_Done && state != cpu_Crashed);
+
+  if (state == cpu_Crashed) {
+    fprintf(stderr, "%s: simulation crashed\n", argv[3]);
+    return EXIT_FAILURE;
+  }
+
+  report(info->mcu);
+  return EXIT_SUCCESS;
+}
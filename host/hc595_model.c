@@ -0,0 +1,42 @@
+/***************************************************************
+ * Behavioural model of a 74HC595 shift register with output
+ * latches.
+ *
+ * @author Carl Harris
+ ***************************************************************/
+
+#include <string.h>
+
+#include "hc595_model.h"
+
+static uint8_t exchange(SimSPIDevice* dev, uint8_t mosi) {
+  HC595Model* m = (HC595Model*) dev;
+  m->shift = mosi;
+  return 0xFF;                  // QH' is not connected to MISO
+}
+
+static void latch_changed(SimRegister r, uint8_t value, uint8_t old,
+    void* ctx) {
+  (void) r;
+  HC595Model* m = ctx;
+  if (!(old & m->latch_mask) && (value & m->latch_mask)) {
+    m->output = m->shift;
+    m->latches++;
+    if (m->changed != NULL) {
+      m->changed(m->ctx, m->output);
+    }
+  }
+}
+
+void hc595_model_init(HC595Model* m, SimRegister latch_port,
+    uint8_t latch_mask, HC595Output changed, void* ctx) {
+  memset(m, 0, sizeof(*m));
+  m->latch_mask = latch_mask;
+  m->changed = changed;
+  m->ctx = ctx;
+  m->spi.exchange = exchange;
+  m->latch_watch.changed = latch_changed;
+  m->latch_watch.ctx = m;
+  sim_spi_attach(&m->spi);
+  sim_watch(latch_port, &m->latch_watch);
+}
@@ -0,0 +1,44 @@
+/***************************************************************
+ * Behavioural model of a 74HC595 8-bit shift register with
+ * output latches on the simulated SPI bus.
+ *
+ * Each byte on the bus is shifted into the register, most
+ * significant bit first, so that bit 0 of the byte ends up on QA
+ * and bit 7 on QH. On the rising edge of the latch pin (RCLK) the
+ * shift register is copied to the outputs.
+ *
+ * @author Carl Harris
+ ***************************************************************/
+
+#ifndef HC595_MODEL_H
+#define HC595_MODEL_H
+
+#include <stdint.h>
+
+#include "sim.h"
+
+typedef void (*HC595Output)(void* ctx, uint8_t output);
+
+typedef struct {
+    SimSPIDevice spi;
+    SimWatch latch_watch;
+    uint8_t latch_mask;
+    uint8_t shift;            /* contents of the shift register */
+    uint8_t output;           /* contents of the output latches */
+    HC595Output changed;      /* called for each latch (or NULL) */
+    void* ctx;
+    uint32_t latches;
+} HC595Model;
+
+/**
+ * Initializes the model and attaches it to the SPI bus.
+ * @param m the model
+ * @param latch_port PORT register of the latch pin
+ * @param latch_mask bit mask of the latch pin
+ * @param changed function called with the outputs on each latch
+ * @param ctx context for the function
+ */
+void hc595_model_init(HC595Model* m, SimRegister latch_port,
+    uint8_t latch_mask, HC595Output changed, void* ctx);
+
+#endif /* HC595_MODEL_H */
@@ -0,0 +1,203 @@
+/***************************************************************
+ * Behavioural model of a Hitachi HD44780 LCD controller.
+ *
+ * @author Carl Harris
+ ***************************************************************/
+
+#include <string.h>
+
+#include "hd44780_model.h"
+#include "sim.h"
+
+#define PIN_RS  0x1
+#define PIN_RW  0x2
+#define PIN_E   0x4
+#define PIN_BL  0x8
+
+/* execution times at the nominal 270 kHz oscillator, in ns */
+#define POWER_ON_NS     40000000ULL
+#define CLEAR_NS        1520000ULL
+#define COMMAND_NS      37000ULL
+#define DATA_NS         41000ULL
+
+#define LINE_LENGTH     40
+#define LINE2_BASE      0x40
+
+HD44780Model* hd44780_model_target;
+
+void hd44780_model_init(HD44780Model* m, uint8_t columns, uint8_t rows) {
+  memset(m, 0, sizeof(*m));
+  m->columns = columns;
+  m->rows = rows;
+  memset(m->ddram, ' ', sizeof(m->ddram));
+  m->increment = true;
+  m->eight_bit = true;
+  m->busy_until = sim_time_ns() + POWER_ON_NS;
+}
+
+static void advance(HD44780Model* m, bool forward) {
+  if (m->cgram_selected) {
+    m->ac = (m->ac + (forward ? 1 : -1)) & 0x3F;
+  }
+  else if (!m->two_lines) {
+    m->ac = forward ? (m->ac + 1) % (2 * LINE_LENGTH)
+        : (m->ac + 2 * LINE_LENGTH - 1) % (2 * LINE_LENGTH);
+  }
+  else if (forward) {
+    m->ac++;
+    if (m->ac == LINE_LENGTH) {
+      m->ac = LINE2_BASE;
+    }
+    else if (m->ac == LINE2_BASE + LINE_LENGTH) {
+      m->ac = 0;
+    }
+  }
+  else if (m->ac == 0) {
+    m->ac = LINE2_BASE + LINE_LENGTH - 1;
+  }
+  else if (m->ac == LINE2_BASE) {
+    m->ac = LINE_LENGTH - 1;
+  }
+  else {
+    m->ac--;
+  }
+}
+
+static void shift_display(HD44780Model* m, bool left) {
+  uint8_t length = m->two_lines ? LINE_LENGTH : 2 * LINE_LENGTH;
+  m->shift = (m->shift + (left ? 1 : length - 1)) % length;
+}
+
+static void write_data(HD44780Model* m, uint8_t d) {
+  if (m->cgram_selected) {
+    m->cgram[m->ac] = d & 0x1F;
+  }
+  else {
+    m->ddram[m->ac] = d;
+  }
+  advance(m, m->increment);
+  if (m->shift_on_write && !m->cgram_selected) {
+    shift_display(m, m->increment);
+  }
+  m->data_writes++;
+}
+
+static uint64_t execute(HD44780Model* m, uint8_t c) {
+  m->instructions++;
+  if (c & 0x80) {
+    m->ac = c & 0x7F;
+    m->cgram_selected = false;
+  }
+  else if (c & 0x40) {
+    m->ac = c & 0x3F;
+    m->cgram_selected = true;
+  }
+  else if (c & 0x20) {
+    m->eight_bit = c & 0x10;
+    m->two_lines = c & 0x08;
+  }
+  else if (c & 0x10) {
+    if (c & 0x08) {
+      shift_display(m, !(c & 0x04));
+    }
+    else {
+      advance(m, c & 0x04);
+    }
+  }
+  else if (c & 0x08) {
+    m->display_on = c & 0x04;
+    m->cursor_on = c & 0x02;
+    m->blink_on = c & 0x01;
+  }
+  else if (c & 0x04) {
+    m->increment = c & 0x02;
+    m->shift_on_write = c & 0x01;
+  }
+  else if (c & 0x02) {
+    m->ac = 0;
+    m->cgram_selected = false;
+    m->shift = 0;
+    return CLEAR_NS;
+  }
+  else if (c & 0x01) {
+    memset(m->ddram, ' ', sizeof(m->ddram));
+    m->ac = 0;
+    m->cgram_selected = false;
+    m->increment = true;
+    m->shift = 0;
+    return CLEAR_NS;
+  }
+  return COMMAND_NS;
+}
+
+/**
+ * Latches the data lines on the falling edge of E.
+ */
+static void latch(HD44780Model* m, uint8_t pins) {
+  uint64_t now = sim_time_ns();
+  if (pins & PIN_RW) {
+    sim_error("HD44780 read is not modelled");
+    return;
+  }
+  if (now < m->busy_until) {
+    m->violations++;
+    return;
+  }
+
+  uint8_t nibble = pins >> 4;
+  uint8_t b;
+  if (m->eight_bit) {
+    b = nibble << 4;              // D3..D0 are not connected
+  }
+  else if (!m->have_high_nibble) {
+    m->high_nibble = nibble;
+    m->have_high_nibble = true;
+    return;
+  }
+  else {
+    b = (m->high_nibble << 4) | nibble;
+    m->have_high_nibble = false;
+  }
+
+  if (pins & PIN_RS) {
+    write_data(m, b);
+    m->busy_until = now + DATA_NS;
+  }
+  else {
+    m->busy_until = now + execute(m, b);
+    if (m->eight_bit) {
+      m->have_high_nibble = false;
+    }
+  }
+}
+
+void hd44780_model_write(HD44780Model* m, uint8_t pins) {
+  m->backlight = pins & PIN_BL;
+  if ((m->pins & PIN_E) && !(pins & PIN_E)) {
+    latch(m, m->pins);
+  }
+  m->pins = pins;
+}
+
+int hd44780_model_lcd_write(uint8_t ctx, uint8_t r) {
+  (void) ctx;
+  hd44780_model_write(hd44780_model_target, r);
+  return 0;
+}
+
+char* hd44780_model_line(HD44780Model* m, uint8_t row, char* buf) {
+  for (uint8_t col = 0; col < m->columns; col++) {
+    uint8_t address;
+    if (m->two_lines) {
+      // rows 2 and 3 of a four row display continue rows 0 and 1
+      uint8_t pos = ((row >> 1) * m->columns + col + m->shift) % LINE_LENGTH;
+      address = ((row & 1) ? LINE2_BASE : 0) + pos;
+    }
+    else {
+      address = (row * m->columns + col + m->shift) % (2 * LINE_LENGTH);
+    }
+    buf[col] = m->ddram[address];
+  }
+  buf[m->columns] = 0;
+  return buf;
+}
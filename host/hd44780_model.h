@@ -0,0 +1,78 @@
+/***************************************************************
+ * Behavioural model of a Hitachi HD44780 LCD controller, driven
+ * through its 4-bit interface as wired by the lcd module.
+ *
+ * The model keeps DDRAM, CGRAM, the address counter and the
+ * display and entry mode state, and checks that each instruction
+ * is latched only after the previous one has finished executing.
+ *
+ * @author Carl Harris
+ ***************************************************************/
+
+#ifndef HD44780_MODEL_H
+#define HD44780_MODEL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct {
+    uint8_t columns;
+    uint8_t rows;
+    uint8_t ddram[0x80];
+    uint8_t cgram[64];
+    uint8_t ac;               /* address counter */
+    bool cgram_selected;      /* address counter refers to CGRAM */
+    bool increment;           /* entry mode I/D */
+    bool shift_on_write;      /* entry mode S */
+    bool display_on;
+    bool cursor_on;
+    bool blink_on;
+    bool eight_bit;           /* interface data length */
+    bool two_lines;
+    bool backlight;
+    uint8_t shift;            /* display shift, in characters */
+    uint8_t pins;             /* last value written to the interface */
+    bool have_high_nibble;
+    uint8_t high_nibble;
+    uint64_t busy_until;      /* virtual time (ns) */
+    uint32_t instructions;    /* instructions executed */
+    uint32_t data_writes;     /* data bytes written */
+    uint32_t violations;      /* writes latched while busy (ignored) */
+} HD44780Model;
+
+/**
+ * Initializes the model in its power-on state.
+ * @param m the model
+ * @param columns number of display columns
+ * @param rows number of display rows (1, 2 or 4)
+ */
+void hd44780_model_init(HD44780Model* m, uint8_t columns, uint8_t rows);
+
+/**
+ * Sets the levels on the controller's interface pins. The data is
+ * latched on the falling edge of E.
+ * @param m the model
+ * @param pins interface pins in the layout described by LCDWrite
+ */
+void hd44780_model_write(HD44780Model* m, uint8_t pins);
+
+/**
+ * An LCDWrite function that drives the model directly. The context
+ * byte is ignored; set hd44780_model_target to the model first.
+ */
+int hd44780_model_lcd_write(uint8_t ctx, uint8_t r);
+
+extern HD44780Model* hd44780_model_target;
+
+/**
+ * Gets the characters visible on a row of the display, taking the
+ * display shift into account.
+ * @param m the model
+ * @param row zero-based row number
+ * @param buf receives the characters and a terminating null; must
+ *      have room for columns + 1 characters
+ * @return buf
+ */
+char* hd44780_model_line(HD44780Model* m, uint8_t row, char* buf);
+
+#endif /* HD44780_MODEL_H */
@@ -0,0 +1,24 @@
+/***************************************************************
+ * Replacement for <avr/interrupt.h> in the host-native build.
+ * An interrupt handler defined with ISR is installed in the
+ * simulation when the program starts.
+ *
+ * @author Carl Harris
+ ***************************************************************/
+
+#ifndef SIM_AVR_INTERRUPT_H
+#define SIM_AVR_INTERRUPT_H
+
+#include <avr/io.h>
+
+#define sei()   (sim_interrupts(true))
+#define cli()   (sim_interrupts(false))
+
+#define ISR(vector, ...) \
+    static void vector##_handler(void); \
+    __attribute__((constructor)) static void vector##_install(void) { \
+      sim_vector(vector, vector##_handler); \
+    } \
+    static void vector##_handler(void)
+
+#endif /* SIM_AVR_INTERRUPT_H */
@@ -0,0 +1,289 @@
+/***************************************************************
+ * Replacement for <avr/io.h> in the host-native build. Each I/O
+ * register is an lvalue in the simulated register file; see
+ * host/sim.h. The USI registers are replaced by those of the TWI
+ * when __AVR_ATmega328P__ is defined.
+ *
+ * @author Carl Harris
+ ***************************************************************/
+
+#ifndef SIM_AVR_IO_H
+#define SIM_AVR_IO_H
+
+#include <stdint.h>
+
+#include "../../sim.h"
+
+#define _BV(bit)        (1 << (bit))
+#define _SIM_REG(r)     (*sim_io(r))
+
+#define SREG            _SIM_REG(SIM_SREG)
+#define PINB            _SIM_REG(SIM_PINB)
+#define DDRB            _SIM_REG(SIM_DDRB)
+#define PORTB           _SIM_REG(SIM_PORTB)
+#define PINC            _SIM_REG(SIM_PINC)
+#define DDRC            _SIM_REG(SIM_DDRC)
+#define PORTC           _SIM_REG(SIM_PORTC)
+#define PIND            _SIM_REG(SIM_PIND)
+#define DDRD            _SIM_REG(SIM_DDRD)
+#define PORTD           _SIM_REG(SIM_PORTD)
+#define SPCR            _SIM_REG(SIM_SPCR)
+#define SPSR            _SIM_REG(SIM_SPSR)
+#define SPDR            _SIM_REG(SIM_SPDR)
+#define UDR0            _SIM_REG(SIM_UDR0)
+#define UCSR0A          _SIM_REG(SIM_UCSR0A)
+#define UCSR0B          _SIM_REG(SIM_UCSR0B)
+#define UCSR0C          _SIM_REG(SIM_UCSR0C)
+#define UBRR0L          _SIM_REG(SIM_UBRR0L)
+#define UBRR0H          _SIM_REG(SIM_UBRR0H)
+#ifdef __AVR_ATmega328P__
+#define TWBR            _SIM_REG(SIM_TWBR)
+#define TWSR            _SIM_REG(SIM_TWSR)
+#define TWDR            _SIM_REG(SIM_TWDR)
+#define TWCR            _SIM_REG(SIM_TWCR)
+#else
+#define USIDR           _SIM_REG(SIM_USIDR)
+#define USIBR           _SIM_REG(SIM_USIBR)
+#define USISR           _SIM_REG(SIM_USISR)
+#define USICR           _SIM_REG(SIM_USICR)
+#endif
+#define TCCR0A          _SIM_REG(SIM_TCCR0A)
+#define TCCR0B          _SIM_REG(SIM_TCCR0B)
+#define TCNT0           _SIM_REG(SIM_TCNT0)
+#define OCR0A           _SIM_REG(SIM_OCR0A)
+#define TIMSK           _SIM_REG(SIM_TIMSK)
+#define TIFR            _SIM_REG(SIM_TIFR)
+#define GPIOR0          _SIM_REG(SIM_GPIOR0)
+#define GPIOR1          _SIM_REG(SIM_GPIOR1)
+#define GPIOR2          _SIM_REG(SIM_GPIOR2)
+
+/* SREG */
+#define SREG_I          7
+#define SREG_T          6
+#define SREG_H          5
+#define SREG_S          4
+#define SREG_V          3
+#define SREG_N          2
+#define SREG_Z          1
+#define SREG_C          0
+
+/* port B */
+#define PB0             0
+#define PB1             1
+#define PB2             2
+#define PB3             3
+#define PB4             4
+#define PB5             5
+#define PB6             6
+#define PB7             7
+#define PINB0           0
+#define PINB1           1
+#define PINB2           2
+#define PINB3           3
+#define PINB4           4
+#define PINB5           5
+#define PINB6           6
+#define PINB7           7
+#define DDB0            0
+#define DDB1            1
+#define DDB2            2
+#define DDB3            3
+#define DDB4            4
+#define DDB5            5
+#define DDB6            6
+#define DDB7            7
+#define PORTB0          0
+#define PORTB1          1
+#define PORTB2          2
+#define PORTB3          3
+#define PORTB4          4
+#define PORTB5          5
+#define PORTB6          6
+#define PORTB7          7
+
+/* port C */
+#define PC0             0
+#define PC1             1
+#define PC2             2
+#define PC3             3
+#define PC4             4
+#define PC5             5
+#define PC6             6
+#define PC7             7
+#define PINC0           0
+#define PINC1           1
+#define PINC2           2
+#define PINC3           3
+#define PINC4           4
+#define PINC5           5
+#define PINC6           6
+#define PINC7           7
+#define DDC0            0
+#define DDC1            1
+#define DDC2            2
+#define DDC3            3
+#define DDC4            4
+#define DDC5            5
+#define DDC6            6
+#define DDC7            7
+#define PORTC0          0
+#define PORTC1          1
+#define PORTC2          2
+#define PORTC3          3
+#define PORTC4          4
+#define PORTC5          5
+#define PORTC6          6
+#define PORTC7          7
+
+/* port D */
+#define PD0             0
+#define PD1             1
+#define PD2             2
+#define PD3             3
+#define PD4             4
+#define PD5             5
+#define PD6             6
+#define PD7             7
+#define PIND0           0
+#define PIND1           1
+#define PIND2           2
+#define PIND3           3
+#define PIND4           4
+#define PIND5           5
+#define PIND6           6
+#define PIND7           7
+#define DDD0            0
+#define DDD1            1
+#define DDD2            2
+#define DDD3            3
+#define DDD4            4
+#define DDD5            5
+#define DDD6            6
+#define DDD7            7
+#define PORTD0          0
+#define PORTD1          1
+#define PORTD2          2
+#define PORTD3          3
+#define PORTD4          4
+#define PORTD5          5
+#define PORTD6          6
+#define PORTD7          7
+
+/* SPCR */
+#define SPIE            7
+#define SPE             6
+#define DORD            5
+#define MSTR            4
+#define CPOL            3
+#define CPHA            2
+#define SPR1            1
+#define SPR0            0
+
+/* SPSR */
+#define SPIF            7
+#define WCOL            6
+#define SPI2X           0
+
+/* UCSR0A */
+#define RXC0            7
+#define TXC0            6
+#define UDRE0           5
+#define FE0             4
+#define DOR0            3
+#define UPE0            2
+#define U2X0            1
+#define MPCM0           0
+
+/* UCSR0B */
+#define RXCIE0          7
+#define TXCIE0          6
+#define UDRIE0          5
+#define RXEN0           4
+#define TXEN0           3
+#define UCSZ02          2
+#define RXB80           1
+#define TXB80           0
+
+/* UCSR0C */
+#define UMSEL01         7
+#define UMSEL00         6
+#define UPM01           5
+#define UPM00           4
+#define USBS0           3
+#define UCSZ01          2
+#define UCSZ00          1
+#define UCPOL0          0
+
+/* USICR */
+#define USISIE          7
+#define USIOIE          6
+#define USIWM1          5
+#define USIWM0          4
+#define USICS1          3
+#define USICS0          2
+#define USICLK          1
+#define USITC           0
+
+/* USISR */
+#define USISIF          7
+#define USIOIF          6
+#define USIPF           5
+#define USIDC           4
+#define USICNT3         3
+#define USICNT2         2
+#define USICNT1         1
+#define USICNT0         0
+
+/* TWCR */
+#define TWINT           7
+#define TWEA            6
+#define TWSTA           5
+#define TWSTO           4
+#define TWWC            3
+#define TWEN            2
+#define TWIE            0
+
+/* TWSR */
+#define TWS7            7
+#define TWS6            6
+#define TWS5            5
+#define TWS4            4
+#define TWS3            3
+#define TWPS1           1
+#define TWPS0           0
+
+/* TCCR0A */
+#define COM0A1          7
+#define COM0A0          6
+#define COM0B1          5
+#define COM0B0          4
+#define WGM01           1
+#define WGM00           0
+
+/* TCCR0B */
+#define FOC0A           7
+#define FOC0B           6
+#define WGM02           3
+#define CS02            2
+#define CS01            1
+#define CS00            0
+
+/* TIMSK and TIFR (Timer/Counter0 bits) */
+#define OCIE0A          4
+#define OCIE0B          3
+#define TOIE0           1
+#define OCF0A           4
+#define OCF0B           3
+#define TOV0            1
+
+/* interrupt vectors */
+#define SPI_STC_vect    SIM_VECTOR_SPI_STC
+#define USART_RX_vect   SIM_VECTOR_USART_RX
+#define USART_UDRE_vect SIM_VECTOR_USART_UDRE
+#define USART_TX_vect   SIM_VECTOR_USART_TX
+#define USI_START_vect  SIM_VECTOR_USI_START
+#define USI_OVF_vect    SIM_VECTOR_USI_OVF
+#define TIMER0_COMPA_vect SIM_VECTOR_TIMER0_COMPA
+#define TWI_vect        SIM_VECTOR_TWI
+
+#endif /* SIM_AVR_IO_H */
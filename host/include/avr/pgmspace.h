@@ -0,0 +1,25 @@
+/***************************************************************
+ * Replacement for <avr/pgmspace.h> in the host-native build.
+ * Program memory is ordinary memory on the host.
+ *
+ * @author Carl Harris
+ ***************************************************************/
+
+#ifndef SIM_AVR_PGMSPACE_H
+#define SIM_AVR_PGMSPACE_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include <avr/io.h>
+
+#define PROGMEM
+#define PSTR(s)                 (s)
+#define pgm_read_byte(addr)     (*(const uint8_t*) (addr))
+#define pgm_read_word(addr)     (*(const uint16_t*) (addr))
+#define pgm_read_dword(addr)    (*(const uint32_t*) (addr))
+#define pgm_read_ptr(addr)      (*(void* const*) (addr))
+#define memcpy_P(dst, src, n)   memcpy((dst), (src), (n))
+#define strlen_P(s)             strlen(s)
+
+#endif /* SIM_AVR_PGMSPACE_H */
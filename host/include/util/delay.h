@@ -0,0 +1,16 @@
+/***************************************************************
+ * Replacement for <util/delay.h> in the host-native build.
+ * Delays advance the virtual clock of the simulation.
+ *
+ * @author Carl Harris
+ ***************************************************************/
+
+#ifndef SIM_UTIL_DELAY_H
+#define SIM_UTIL_DELAY_H
+
+#include <avr/io.h>
+
+#define _delay_us(us)   (sim_delay_us(us))
+#define _delay_ms(ms)   (sim_delay_us((ms) * 1000.0))
+
+#endif /* SIM_UTIL_DELAY_H */
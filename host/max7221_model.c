@@ -0,0 +1,120 @@
+/***************************************************************
+ * Behavioural model of a chain of MAX7221 LED display drivers.
+ *
+ * @author Carl Harris
+ ***************************************************************/
+
+#include <string.h>
+
+#include "max7221_model.h"
+
+#define REG_NOOP          0x00
+#define REG_DECODE_MODE   0x09
+#define REG_SCAN_LIMIT    0x0B
+#define REG_SHUTDOWN      0x0C
+#define REG_DISPLAY_TEST  0x0F
+
+#define SEGMENT_DP        0x80
+
+static const char CODE_B[] = "0123456789-EHLP ";
+
+static const struct {
+    uint8_t segments;
+    char c;
+} SEGMENT_CHARS[] = {
+    { 0x7E, '0' }, { 0x30, '1' }, { 0x6D, '2' }, { 0x79, '3' },
+    { 0x33, '4' }, { 0x5B, '5' }, { 0x5F, '6' }, { 0x70, '7' },
+    { 0x7F, '8' }, { 0x7B, '9' }, { 0x77, 'A' }, { 0x1F, 'b' },
+    { 0x4E, 'C' }, { 0x3D, 'd' }, { 0x4F, 'E' }, { 0x47, 'F' },
+    { 0x01, '-' }, { 0x08, '_' }, { 0x00, ' ' },
+};
+
+static uint8_t exchange(SimSPIDevice* dev, uint8_t mosi) {
+  MAX7221Model* m = (MAX7221Model*) dev;
+  if (m->selected) {
+    memmove(&m->shift[1], &m->shift[0], 2 * m->count - 1);
+    m->shift[0] = mosi;
+  }
+  return 0xFF;                  // DOUT is not connected to MISO
+}
+
+static void cs_changed(SimRegister r, uint8_t value, uint8_t old, void* ctx) {
+  (void) r;
+  MAX7221Model* m = ctx;
+  bool was_high = old & m->cs_mask;
+  bool high = value & m->cs_mask;
+  if (was_high && !high) {
+    m->selected = true;
+  }
+  else if (!was_high && high && m->selected) {
+    m->selected = false;
+    for (uint8_t i = 0; i < m->count; i++) {
+      uint8_t address = m->shift[2 * i + 1] & 0x0F;
+      if (address != REG_NOOP) {
+        m->registers[i][address] = m->shift[2 * i];
+        m->loads++;
+      }
+    }
+  }
+}
+
+void max7221_model_init(MAX7221Model* m, SimRegister cs_port,
+    uint8_t cs_mask, uint8_t count) {
+  memset(m, 0, sizeof(*m));
+  m->cs_mask = cs_mask;
+  m->count = count < MAX7221_MODEL_DEVICES ? count : MAX7221_MODEL_DEVICES;
+  m->spi.exchange = exchange;
+  m->cs_watch.changed = cs_changed;
+  m->cs_watch.ctx = m;
+  sim_spi_attach(&m->spi);
+  sim_watch(cs_port, &m->cs_watch);
+}
+
+uint8_t max7221_model_register(MAX7221Model* m, uint8_t device,
+    uint8_t address) {
+  sim_sync();
+  return m->registers[device][address & 0x0F];
+}
+
+static char segment_char(uint8_t segments) {
+  for (size_t i = 0; i < sizeof(SEGMENT_CHARS) / sizeof(SEGMENT_CHARS[0]); i++) {
+    if (SEGMENT_CHARS[i].segments == segments) {
+      return SEGMENT_CHARS[i].c;
+    }
+  }
+  return '?';
+}
+
+char* max7221_model_text(MAX7221Model* m, uint8_t device, char* buf) {
+  sim_sync();
+  const uint8_t* regs = m->registers[device];
+  bool test = regs[REG_DISPLAY_TEST] & 0x01;
+  bool on = regs[REG_SHUTDOWN] & 0x01;
+  char* p = buf;
+
+  for (uint8_t digit = 8; digit > 0; digit--) {
+    uint8_t data = regs[digit];
+    bool point;
+    if (test) {
+      *p++ = '8';
+      point = true;
+    }
+    else if (!on || digit - 1 > (regs[REG_SCAN_LIMIT] & 0x07)) {
+      *p++ = ' ';
+      point = false;
+    }
+    else if (regs[REG_DECODE_MODE] & (1 << (digit - 1))) {
+      *p++ = CODE_B[data & 0x0F];
+      point = data & SEGMENT_DP;
+    }
+    else {
+      *p++ = segment_char(data & ~SEGMENT_DP);
+      point = data & SEGMENT_DP;
+    }
+    if (point) {
+      *p++ = '.';
+    }
+  }
+  *p = 0;
+  return buf;
+}
@@ -0,0 +1,65 @@
+/***************************************************************
+ * Behavioural model of a chain of MAX7221 LED display drivers on
+ * the simulated SPI bus.
+ *
+ * While the chip select pin is low each byte on the bus is shifted
+ * into the chain of 16-bit shift registers. On the rising edge of
+ * chip select each device loads the register addressed by the word
+ * in its shift register.
+ *
+ * @author Carl Harris
+ ***************************************************************/
+
+#ifndef MAX7221_MODEL_H
+#define MAX7221_MODEL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sim.h"
+
+#ifndef MAX7221_MODEL_DEVICES
+#define MAX7221_MODEL_DEVICES   8
+#endif
+
+typedef struct {
+    SimSPIDevice spi;
+    SimWatch cs_watch;
+    uint8_t cs_mask;
+    uint8_t count;                                /* devices in the chain */
+    bool selected;
+    uint8_t shift[2 * MAX7221_MODEL_DEVICES];     /* most recent byte first */
+    uint8_t registers[MAX7221_MODEL_DEVICES][16];
+    uint32_t loads;             /* register writes (not no-ops) loaded */
+} MAX7221Model;
+
+/**
+ * Initializes the model and attaches it to the SPI bus.
+ * @param m the model
+ * @param cs_port PORT register of the chip select pin
+ * @param cs_mask bit mask of the chip select pin
+ * @param count number of devices in the chain
+ */
+void max7221_model_init(MAX7221Model* m, SimRegister cs_port,
+    uint8_t cs_mask, uint8_t count);
+
+/**
+ * Gets the value of a register of a device in the chain.
+ * @param device zero-based index of the device; device 0 is the one
+ *      connected to the microcontroller
+ */
+uint8_t max7221_model_register(MAX7221Model* m, uint8_t device,
+    uint8_t address);
+
+/**
+ * Gets the characters shown by the digits of a device, leftmost (digit
+ * register 8) first. A lit decimal point follows its digit as '.'; a digit that
+ * is not scanned, or that shows a segment pattern with no character
+ * equivalent, is shown as ' ' or '?' respectively.
+ * @param buf receives the text and a terminating null; must have room
+ *      for 17 characters
+ * @return buf
+ */
+char* max7221_model_text(MAX7221Model* m, uint8_t device, char* buf);
+
+#endif /* MAX7221_MODEL_H */
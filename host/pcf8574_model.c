@@ -0,0 +1,38 @@
+/***************************************************************
+ * Behavioural model of a PCF8574 I2C 8-bit I/O expander.
+ *
+ * @author Carl Harris
+ ***************************************************************/
+
+#include <string.h>
+
+#include "pcf8574_model.h"
+
+static bool write(SimI2CDevice* dev, uint8_t data) {
+  PCF8574Model* m = (PCF8574Model*) dev;
+  m->output = data;
+  m->writes++;
+  if (m->changed != NULL) {
+    m->changed(m->ctx, data);
+  }
+  return true;
+}
+
+static uint8_t read(SimI2CDevice* dev) {
+  PCF8574Model* m = (PCF8574Model*) dev;
+  m->reads++;
+  return m->output & m->input;
+}
+
+void pcf8574_model_init(PCF8574Model* m, uint8_t address,
+    PCF8574Output changed, void* ctx) {
+  memset(m, 0, sizeof(*m));
+  m->output = 0xFF;               // quasi-bidirectional pins power up high
+  m->input = 0xFF;
+  m->changed = changed;
+  m->ctx = ctx;
+  m->i2c.address = address;
+  m->i2c.write = write;
+  m->i2c.read = read;
+  sim_i2c_attach(&m->i2c);
+}
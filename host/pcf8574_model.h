@@ -0,0 +1,42 @@
+/***************************************************************
+ * Behavioural model of a PCF8574 I2C 8-bit I/O expander on the
+ * simulated two-wire bus, as used on HD44780 LCD backpacks.
+ *
+ * Each byte written by the master sets the port outputs; a read
+ * returns the level of each pin, which is low if either the output
+ * or the external circuit pulls it low.
+ *
+ * @author Carl Harris
+ ***************************************************************/
+
+#ifndef PCF8574_MODEL_H
+#define PCF8574_MODEL_H
+
+#include <stdint.h>
+
+#include "sim.h"
+
+typedef void (*PCF8574Output)(void* ctx, uint8_t output);
+
+typedef struct {
+    SimI2CDevice i2c;
+    uint8_t output;           /* last byte written */
+    uint8_t input;            /* levels driven by the external circuit */
+    PCF8574Output changed;    /* called for each byte written (or NULL) */
+    void* ctx;
+    uint32_t writes;
+    uint32_t reads;
+} PCF8574Model;
+
+/**
+ * Initializes the model and attaches it to the two-wire bus.
+ * @param m the model
+ * @param address 7-bit bus address (0x20..0x27, or 0x38..0x3F for the
+ *      PCF8574A)
+ * @param changed function called with each byte written to the port
+ * @param ctx context for the function
+ */
+void pcf8574_model_init(PCF8574Model* m, uint8_t address,
+    PCF8574Output changed, void* ctx);
+
+#endif /* PCF8574_MODEL_H */
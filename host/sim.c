@@ -0,0 +1,306 @@
+/***************************************************************
+ * Core of the host-native simulation: the register file, the
+ * virtual clock and its event queue, port pins and interrupts.
+ *
+ * A register access is completed lazily. sim_io records the
+ * register and its value and returns a pointer to its cell; the
+ * next call to sim_io (or sim_sync) compares the cell with the
+ * recorded value to tell whether the access was a write. Models
+ * of data registers such as SPDR and UDR0, where writing the same
+ * value twice matters, use the state of the peripheral to decide.
+ *
+ * @author Carl Harris
+ ***************************************************************/
+
+#include <avr/io.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim.h"
+
+#define SIM_MAX_EVENTS        320
+#define SIM_IDLE_ACCESSES     1000
+#define SIM_STALL_ACCESSES    10000000UL
+#define SIM_MAX_NESTED_IRQS   1000
+#define SIM_NO_REGISTER       SIM_REGISTER_COUNT
+
+#define SIM_PORT_INDEX(port)  (((port) - SIM_PINB) / 3)
+#define SIM_PORT_COUNT        3
+
+typedef struct {
+    uint64_t time;
+    SimEventFn fn;
+    void* ctx;
+} SimEvent;
+
+static const char* const REGISTER_NAMES[SIM_REGISTER_COUNT] = {
+    "SREG",
+    "PINB", "DDRB", "PORTB",
+    "PINC", "DDRC", "PORTC",
+    "PIND", "DDRD", "PORTD",
+    "SPCR", "SPSR", "SPDR",
+    "UDR0", "UCSR0A", "UCSR0B", "UCSR0C", "UBRR0L", "UBRR0H",
+    "USIDR", "USIBR", "USISR", "USICR",
+    "TWBR", "TWSR", "TWDR", "TWCR",
+    "TCCR0A", "TCCR0B", "TCNT0", "OCR0A", "TIMSK", "TIFR",
+    "GPIOR0", "GPIOR1", "GPIOR2",
+};
+
+static uint8_t cells[SIM_REGISTER_COUNT];
+static const SimRegisterModel* models[SIM_REGISTER_COUNT];
+static SimWatch* watches[SIM_REGISTER_COUNT];
+
+static SimRegister pending = SIM_NO_REGISTER;
+static uint8_t pending_value;
+static bool pending_forced;
+
+static uint64_t now;
+static unsigned long accesses;      // since the clock last advanced
+                                    // other than by being idle
+static SimEvent events[SIM_MAX_EVENTS];
+static uint16_t event_count;
+
+static uint8_t input_mask[SIM_PORT_COUNT];
+static uint8_t input_level[SIM_PORT_COUNT];
+
+static SimHandler handlers[SIM_VECTOR_COUNT];
+static bool (*sources[SIM_VECTOR_COUNT])(void);
+static bool in_handler;
+
+SimCounters sim_counts;
+
+static bool is_pin_register(SimRegister r) {
+  return r == SIM_PINB || r == SIM_PINC || r == SIM_PIND;
+}
+
+static bool is_port_register(SimRegister r) {
+  return r == SIM_PORTB || r == SIM_PORTC || r == SIM_PORTD;
+}
+
+static uint8_t pin_level(SimRegister pin) {
+  uint8_t i = SIM_PORT_INDEX(pin);
+  return (input_mask[i] & input_level[i]) | (~input_mask[i] & cells[pin + 2]);
+}
+
+static void notify(SimRegister r, uint8_t old) {
+  for (SimWatch* w = watches[r]; w != NULL; w = w->next) {
+    w->changed(r, cells[r], old, w->ctx);
+  }
+}
+
+/**
+ * Runs the handlers of any interrupts that are pending and enabled.
+ */
+static void dispatch(void) {
+  int taken = 0;
+  bool again = true;
+  while (again && !in_handler && (cells[SIM_SREG] & (1 << SREG_I))) {
+    again = false;
+    for (int v = 0; v < SIM_VECTOR_COUNT; v++) {
+      if (handlers[v] == NULL || sources[v] == NULL || !sources[v]()) {
+        continue;
+      }
+      if (++taken > SIM_MAX_NESTED_IRQS) {
+        fprintf(stderr, "sim: interrupt %d is never cleared\n", v);
+        abort();
+      }
+      in_handler = true;
+      cells[SIM_SREG] &= ~(1 << SREG_I);
+      sim_counts.interrupts++;
+      handlers[v]();
+      sim_sync();
+      cells[SIM_SREG] |= (1 << SREG_I);
+      in_handler = false;
+      again = true;
+      break;
+    }
+  }
+}
+
+void sim_sync(void) {
+  if (pending == SIM_NO_REGISTER) {
+    return;
+  }
+  SimRegister r = pending;
+  uint8_t old = pending_value;
+  pending = SIM_NO_REGISTER;
+
+  if (cells[r] == old && !pending_forced) {
+    return;
+  }
+  if (is_pin_register(r)) {
+    cells[r] = pin_level(r);      // writing PINx is not modelled
+    return;
+  }
+  if (models[r] != NULL && models[r]->write != NULL) {
+    models[r]->write(r, cells[r], old);
+  }
+  notify(r, old);
+}
+
+volatile uint8_t* sim_io(SimRegister r) {
+  sim_sync();
+  dispatch();
+
+  // code that keeps polling without the clock advancing is idle
+  // until the next event, but still stalls if it never stops
+  if (++accesses % SIM_IDLE_ACCESSES == 0 && event_count != 0) {
+    unsigned long idle = accesses;
+    sim_advance_to(events[0].time);
+    accesses = idle;
+  }
+  if (accesses > SIM_STALL_ACCESSES) {
+    fprintf(stderr, "sim: stalled at %llu ns polling %s\n",
+        (unsigned long long) now, REGISTER_NAMES[r]);
+    abort();
+  }
+
+  bool forced = false;
+  if (models[r] != NULL && models[r]->access != NULL) {
+    forced = models[r]->access(r);
+  }
+  if (is_pin_register(r)) {
+    cells[r] = pin_level(r);
+  }
+
+  pending = r;
+  pending_value = cells[r];
+  pending_forced = forced;
+  return (volatile uint8_t*) &cells[r];
+}
+
+void sim_at(uint64_t time_ns, SimEventFn fn, void* ctx) {
+  if (event_count == SIM_MAX_EVENTS) {
+    fprintf(stderr, "sim: too many scheduled events\n");
+    abort();
+  }
+  // events at the same time run in the order they were scheduled
+  uint16_t i = event_count++;
+  while (i > 0 && events[i - 1].time > time_ns) {
+    events[i] = events[i - 1];
+    i--;
+  }
+  events[i].time = time_ns;
+  events[i].fn = fn;
+  events[i].ctx = ctx;
+}
+
+void sim_advance_to(uint64_t time_ns) {
+  sim_sync();
+  while (event_count != 0 && events[0].time <= time_ns) {
+    SimEvent event = events[0];
+    memmove(&events[0], &events[1], --event_count * sizeof(SimEvent));
+    if (event.time > now) {
+      now = event.time;
+    }
+    event.fn(event.ctx);
+    sim_sync();
+    dispatch();
+    accesses = 0;
+  }
+  if (time_ns > now) {
+    now = time_ns;
+    accesses = 0;
+  }
+}
+
+void sim_delay_us(double us) {
+  if (us > 0) {
+    sim_advance_to(now + (uint64_t) llround(us * 1000.0));
+  }
+  else {
+    sim_sync();
+  }
+}
+
+uint64_t sim_time_ns(void) {
+  sim_sync();
+  return now;
+}
+
+const SimCounters* sim_counters(void) {
+  sim_sync();
+  return &sim_counts;
+}
+
+void sim_interrupts(bool enable) {
+  sim_sync();
+  if (enable) {
+    cells[SIM_SREG] |= (1 << SREG_I);
+    dispatch();
+  }
+  else {
+    cells[SIM_SREG] &= ~(1 << SREG_I);
+  }
+}
+
+void sim_vector(SimVector vector, SimHandler handler) {
+  handlers[vector] = handler;
+}
+
+void sim_irq_source(SimVector vector, bool (*pending)(void)) {
+  sources[vector] = pending;
+}
+
+void sim_watch(SimRegister r, SimWatch* watch) {
+  watch->next = watches[r];
+  watches[r] = watch;
+}
+
+void sim_model(SimRegister r, const SimRegisterModel* model) {
+  models[r] = model;
+}
+
+uint8_t* sim_cell(SimRegister r) {
+  return &cells[r];
+}
+
+void sim_port_written(SimRegister port, uint8_t old) {
+  if (cells[port] != old) {
+    notify(port, old);
+  }
+}
+
+void sim_pin_input(SimRegister port, uint8_t mask, uint8_t level) {
+  if (!is_port_register(port)) {
+    return;
+  }
+  uint8_t i = SIM_PORT_INDEX(port);
+  input_mask[i] |= mask;
+  input_level[i] = (input_level[i] & ~mask) | (level & mask);
+}
+
+void sim_error(const char* fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  fprintf(stderr, "sim: ");
+  vfprintf(stderr, fmt, args);
+  fprintf(stderr, "\n");
+  va_end(args);
+  sim_counts.errors++;
+}
+
+void sim_reset(void) {
+  pending = SIM_NO_REGISTER;
+  memset(cells, 0, sizeof(cells));
+  memset(models, 0, sizeof(models));
+  memset(watches, 0, sizeof(watches));
+  memset(sources, 0, sizeof(sources));
+  memset(input_mask, 0, sizeof(input_mask));
+  memset(input_level, 0, sizeof(input_level));
+  memset(&sim_counts, 0, sizeof(sim_counts));
+  now = 0;
+  accesses = 0;
+  event_count = 0;
+  in_handler = false;
+
+  // handlers are installed once, when the program starts
+  sim_spi_reset();
+  sim_usart_reset();
+  sim_usi_reset();
+  sim_timer0_reset();
+  sim_twi_reset();
+}
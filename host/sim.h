@@ -0,0 +1,263 @@
+/***************************************************************
+ * Host-native simulation of the AVR peripherals used by the
+ * library modules, so that the modules can be compiled and run
+ * on a development host.
+ *
+ * The replacement <avr/io.h> in the include directory maps each
+ * I/O register to a cell in a simulated register file. Every
+ * access to a register goes through sim_io, which gives the
+ * peripheral models a chance to prepare the value that will be
+ * read, and to act on the value written by the previous access.
+ * The replacement <util/delay.h> advances a virtual clock instead
+ * of spinning, and polling a status flag that a peripheral will
+ * set in the future advances the virtual clock to that moment.
+ *
+ * Code that spins without advancing the clock, e.g. waiting for a
+ * flag that an interrupt handler will set, is taken to be idle until
+ * the next scheduled event, to which the clock then advances.
+ *
+ * The simulated microcontroller has the ports, SPI, USART0 and TWI
+ * of the ATmega328P, and the USI and Timer/Counter0 of the ATtiny85,
+ * with the two-wire bus on PB0 (SDA) and PB2 (SCL). The replacement
+ * <avr/io.h> defines the TWI registers when __AVR_ATmega328P__ is
+ * defined, and the USI registers otherwise, as the real headers do.
+ *
+ * @author Carl Harris
+ ***************************************************************/
+
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef F_CPU
+#define F_CPU 16000000UL
+#endif
+
+#define SIM_NEVER   UINT64_MAX
+
+typedef enum {
+    SIM_SREG,
+    SIM_PINB, SIM_DDRB, SIM_PORTB,
+    SIM_PINC, SIM_DDRC, SIM_PORTC,
+    SIM_PIND, SIM_DDRD, SIM_PORTD,
+    SIM_SPCR, SIM_SPSR, SIM_SPDR,
+    SIM_UDR0, SIM_UCSR0A, SIM_UCSR0B, SIM_UCSR0C, SIM_UBRR0L, SIM_UBRR0H,
+    SIM_USIDR, SIM_USIBR, SIM_USISR, SIM_USICR,
+    SIM_TWBR, SIM_TWSR, SIM_TWDR, SIM_TWCR,
+    SIM_TCCR0A, SIM_TCCR0B, SIM_TCNT0, SIM_OCR0A, SIM_TIMSK, SIM_TIFR,
+    SIM_GPIOR0, SIM_GPIOR1, SIM_GPIOR2,
+    SIM_REGISTER_COUNT
+} SimRegister;
+
+typedef enum {
+    SIM_VECTOR_SPI_STC,
+    SIM_VECTOR_USART_RX,
+    SIM_VECTOR_USART_UDRE,
+    SIM_VECTOR_USART_TX,
+    SIM_VECTOR_USI_START,
+    SIM_VECTOR_USI_OVF,
+    SIM_VECTOR_TIMER0_COMPA,
+    SIM_VECTOR_TWI,
+    SIM_VECTOR_COUNT
+} SimVector;
+
+typedef void (*SimHandler)(void);
+
+/**
+ * Callback for a change to the value of a register.
+ * @param r the register that was written
+ * @param value the new value of the register
+ * @param old the value of the register before the write
+ * @param ctx context given when the watch was added
+ */
+typedef void (*SimWatchFn)(SimRegister r, uint8_t value, uint8_t old,
+    void* ctx);
+
+/**
+ * A watch on a register, allocated by the caller.
+ */
+typedef struct SimWatch {
+    SimWatchFn changed;
+    void* ctx;
+    struct SimWatch* next;
+} SimWatch;
+
+/**
+ * Callback for an event scheduled on the virtual clock.
+ */
+typedef void (*SimEventFn)(void* ctx);
+
+/**
+ * Bus activity and errors observed since the last reset.
+ */
+typedef struct {
+    uint32_t spi_bytes;       /* bytes exchanged on the SPI bus */
+    uint32_t uart_tx_bytes;   /* bytes transmitted by the USART */
+    uint32_t uart_rx_bytes;   /* bytes received by the USART */
+    uint32_t twi_starts;      /* start and repeated start conditions */
+    uint32_t twi_bytes;       /* bytes (including address bytes) */
+    uint32_t twi_nacks;       /* bytes not acknowledged */
+    uint32_t interrupts;      /* interrupt handlers run */
+    uint32_t errors;          /* misuse of a peripheral, see stderr */
+} SimCounters;
+
+/**
+ * A byte-oriented device on the simulated two-wire bus. The bus model
+ * handles the bit-level protocol. Embed this structure in the device's
+ * own state.
+ */
+typedef struct SimI2CDevice {
+    uint8_t address;
+    /** addressed by the master; read is set for a master read */
+    void (*start)(struct SimI2CDevice* dev, bool read);
+    /** receives a byte from the master; returns true to acknowledge */
+    bool (*write)(struct SimI2CDevice* dev, uint8_t data);
+    /** supplies a byte for the master to read */
+    uint8_t (*read)(struct SimI2CDevice* dev);
+    /** stop condition, or repeated start, ending the transfer */
+    void (*stop)(struct SimI2CDevice* dev);
+    struct SimI2CDevice* next;
+} SimI2CDevice;
+
+/**
+ * A device on the simulated SPI bus. Every device sees every byte;
+ * a device that is not selected returns 0xFF.
+ */
+typedef struct SimSPIDevice {
+    uint8_t (*exchange)(struct SimSPIDevice* dev, uint8_t mosi);
+    struct SimSPIDevice* next;
+} SimSPIDevice;
+
+/**
+ * A peer connected to the USART transmit line.
+ */
+typedef struct SimUARTDevice {
+    void (*receive)(struct SimUARTDevice* dev, uint8_t data);
+    struct SimUARTDevice* next;
+} SimUARTDevice;
+
+/**
+ * Resets the simulated microcontroller, the virtual clock and the
+ * counters, and detaches all devices and watches.
+ */
+void sim_reset(void);
+
+/**
+ * Accesses an I/O register. Used by the register macros in the
+ * replacement <avr/io.h>; not normally called directly.
+ * @param r the register to access
+ * @return pointer through which the register is read or written
+ */
+volatile uint8_t* sim_io(SimRegister r);
+
+/**
+ * Completes the most recent register access, so that a value written
+ * to a register takes effect. Called by every function that inspects
+ * the simulation.
+ */
+void sim_sync(void);
+
+/**
+ * Advances the virtual clock, running any scheduled events and
+ * interrupt handlers that fall due.
+ * @param us microseconds to advance
+ */
+void sim_delay_us(double us);
+
+/**
+ * Gets the time on the virtual clock.
+ * @return nanoseconds since the last reset
+ */
+uint64_t sim_time_ns(void);
+
+/**
+ * Gets the bus activity and error counters.
+ */
+const SimCounters* sim_counters(void);
+
+/**
+ * Enables or disables interrupts, as by sei() and cli().
+ */
+void sim_interrupts(bool enable);
+
+/**
+ * Installs an interrupt handler. Used by the ISR macro in the
+ * replacement <avr/interrupt.h>.
+ */
+void sim_vector(SimVector vector, SimHandler handler);
+
+/**
+ * Adds a watch that is called each time the given register is written
+ * with a new value.
+ */
+void sim_watch(SimRegister r, SimWatch* watch);
+
+/**
+ * Sets the level driven onto port pins by something outside the
+ * microcontroller. Pins in the mask read the given level; other pins
+ * read the value of the PORT register.
+ * @param port the PORT register of the port
+ * @param mask pins that are driven externally
+ * @param level level of each externally driven pin
+ */
+void sim_pin_input(SimRegister port, uint8_t mask, uint8_t level);
+
+/**
+ * Reports misuse of a peripheral by the code under test.
+ */
+void sim_error(const char* fmt, ...);
+
+void sim_spi_attach(SimSPIDevice* dev);
+void sim_uart_attach(SimUARTDevice* dev);
+
+/**
+ * Schedules bytes to arrive at the USART receiver, one frame apart at
+ * the configured baud rate.
+ */
+void sim_uart_send(const uint8_t* data, uint8_t length);
+
+void sim_i2c_attach(SimI2CDevice* dev);
+
+/**
+ * Holds SCL low, as a slave that stretches the clock does, or
+ * releases it.
+ */
+void sim_i2c_hold_scl(bool hold);
+
+/*
+ * Interface between the core and the peripheral models.
+ */
+typedef struct {
+    /** called before a register is accessed; returns true if the access
+     *  must be treated as a write even if the value is unchanged */
+    bool (*access)(SimRegister r);
+    /** called when a register access has completed with a write */
+    void (*write)(SimRegister r, uint8_t value, uint8_t old);
+} SimRegisterModel;
+
+extern SimCounters sim_counts;
+
+void sim_model(SimRegister r, const SimRegisterModel* model);
+uint8_t* sim_cell(SimRegister r);
+void sim_at(uint64_t time_ns, SimEventFn fn, void* ctx);
+void sim_advance_to(uint64_t time_ns);
+/** pending returns true when the interrupt is taken, clearing any flag
+ *  that the hardware clears when the interrupt vector is executed */
+void sim_irq_source(SimVector vector, bool (*pending)(void));
+void sim_port_written(SimRegister port, uint8_t old);
+
+/** the device on the two-wire bus with the given address, or NULL */
+SimI2CDevice* sim_i2c_find(uint8_t address);
+/** true while sim_i2c_hold_scl holds SCL low */
+bool sim_i2c_scl_held(void);
+
+void sim_spi_reset(void);
+void sim_usart_reset(void);
+void sim_usi_reset(void);
+void sim_timer0_reset(void);
+void sim_twi_reset(void);
+
+#endif /* SIM_H */
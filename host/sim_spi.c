@@ -0,0 +1,109 @@
+/***************************************************************
+ * Model of the SPI peripheral of the ATmega328P in master mode.
+ *
+ * Writing SPDR starts a transfer, which completes eight SCK
+ * periods later on the virtual clock. Each attached device sees
+ * the byte when the transfer completes, and SPDR then holds the
+ * byte returned by the devices. An access to SPDR while SPIF is
+ * set is taken to be a read.
+ *
+ * @author Carl Harris
+ ***************************************************************/
+
+#include <avr/io.h>
+
+#include "sim.h"
+
+static SimSPIDevice* devices;
+static bool busy;
+static uint8_t tx;
+static uint64_t done;
+
+static uint32_t sck_divider(void) {
+  static const uint8_t DIVIDERS[] = { 4, 16, 64, 128 };
+  uint32_t divider = DIVIDERS[*sim_cell(SIM_SPCR) & 0x3];
+  if (*sim_cell(SIM_SPSR) & (1 << SPI2X)) {
+    divider /= 2;
+  }
+  return divider;
+}
+
+static void complete(void* ctx) {
+  (void) ctx;
+  uint8_t miso = 0xFF;
+  for (SimSPIDevice* dev = devices; dev != NULL; dev = dev->next) {
+    miso &= dev->exchange(dev, tx);
+  }
+  busy = false;
+  *sim_cell(SIM_SPDR) = miso;
+  *sim_cell(SIM_SPSR) |= (1 << SPIF);
+  sim_counts.spi_bytes++;
+}
+
+static bool spdr_access(SimRegister r) {
+  (void) r;
+  uint8_t* spsr = sim_cell(SIM_SPSR);
+  if (!busy && (*spsr & (1 << SPIF))) {
+    *spsr &= ~((1 << SPIF) | (1 << WCOL));
+    return false;
+  }
+  return true;
+}
+
+static void spdr_write(SimRegister r, uint8_t value, uint8_t old) {
+  (void) r;
+  (void) old;
+  uint8_t spcr = *sim_cell(SIM_SPCR);
+  if (busy) {
+    *sim_cell(SIM_SPSR) |= (1 << WCOL);
+    sim_error("SPDR written during a transfer");
+    return;
+  }
+  if ((spcr & ((1 << SPE) | (1 << MSTR))) != ((1 << SPE) | (1 << MSTR))) {
+    sim_error("SPDR written with the SPI not enabled as master");
+    return;
+  }
+  busy = true;
+  tx = value;
+  done = sim_time_ns()
+      + (uint64_t) 8 * sck_divider() * 1000000000ULL / F_CPU;
+  sim_at(done, complete, NULL);
+}
+
+static bool spsr_access(SimRegister r) {
+  (void) r;
+  if (busy) {
+    sim_advance_to(done);
+  }
+  return false;
+}
+
+static void spsr_write(SimRegister r, uint8_t value, uint8_t old) {
+  // only SPI2X is writable
+  *sim_cell(r) = (old & ~(1 << SPI2X)) | (value & (1 << SPI2X));
+}
+
+static bool spi_pending(void) {
+  uint8_t* spsr = sim_cell(SIM_SPSR);
+  if ((*sim_cell(SIM_SPCR) & (1 << SPIE)) && (*spsr & (1 << SPIF))) {
+    *spsr &= ~(1 << SPIF);
+    return true;
+  }
+  return false;
+}
+
+static const SimRegisterModel SPDR_MODEL = { spdr_access, spdr_write };
+static const SimRegisterModel SPSR_MODEL = { spsr_access, spsr_write };
+
+void sim_spi_attach(SimSPIDevice* dev) {
+  dev->next = devices;
+  devices = dev;
+}
+
+void sim_spi_reset(void) {
+  devices = NULL;
+  busy = false;
+  sim_model(SIM_SPDR, &SPDR_MODEL);
+  sim_model(SIM_SPSR, &SPSR_MODEL);
+  sim_irq_source(SIM_VECTOR_SPI_STC, spi_pending);
+}
@@ -0,0 +1,91 @@
+/***************************************************************
+ * Model of Timer/Counter0 of the ATtiny85, limited to what the
+ * interrupt-driven USI backend uses: a compare match on OCR0A in
+ * normal or CTC mode, with its interrupt.
+ *
+ * Matches are scheduled on the virtual clock from the moment the
+ * clock select, TCNT0 or OCR0A is written. TCNT0 is not counted
+ * between matches; it reads as the value last written, or zero
+ * after a match in CTC mode. The output compare pins and
+ * compare match B are not modelled.
+ *
+ * @author Carl Harris
+ ***************************************************************/
+
+#include <stdint.h>
+#include <avr/io.h>
+
+#include "sim.h"
+
+static uint32_t generation;       // identifies the current schedule
+
+static uint32_t prescale(void) {
+  static const uint16_t PRESCALERS[] = { 0, 1, 8, 64, 256, 1024, 0, 0 };
+  return PRESCALERS[*sim_cell(SIM_TCCR0B) & 0x07];
+}
+
+static uint64_t count_ns(void) {
+  return (uint64_t) prescale() * 1000000000ULL / F_CPU;
+}
+
+/* counts from zero to the next match */
+static uint16_t period(void) {
+  uint8_t ocr = *sim_cell(SIM_OCR0A);
+  return (*sim_cell(SIM_TCCR0A) & (1 << WGM01)) ? ocr + 1 : 256;
+}
+
+static void match(void* ctx) {
+  if ((uint32_t) (uintptr_t) ctx != generation) {
+    return;                       // the timer was reconfigured
+  }
+  *sim_cell(SIM_TIFR) |= (1 << OCF0A);
+  *sim_cell(SIM_TCNT0) = 0;
+  sim_at(sim_time_ns() + period() * count_ns(), match,
+      (void*) (uintptr_t) generation);
+}
+
+static void schedule(void) {
+  generation++;
+  if (prescale() == 0) {
+    return;                       // stopped, or an external clock
+  }
+  uint8_t ocr = *sim_cell(SIM_OCR0A);
+  uint8_t tcnt = *sim_cell(SIM_TCNT0);
+  uint16_t counts = (uint8_t) (ocr - tcnt) + 1;
+  sim_at(sim_time_ns() + counts * count_ns(), match,
+      (void*) (uintptr_t) generation);
+}
+
+static void config_write(SimRegister r, uint8_t value, uint8_t old) {
+  (void) r;
+  (void) value;
+  (void) old;
+  schedule();
+}
+
+static void tifr_write(SimRegister r, uint8_t value, uint8_t old) {
+  // flags are cleared by writing a one
+  *sim_cell(r) = old & ~value;
+}
+
+static bool compare_pending(void) {
+  uint8_t* tifr = sim_cell(SIM_TIFR);
+  if ((*sim_cell(SIM_TIMSK) & (1 << OCIE0A)) && (*tifr & (1 << OCF0A))) {
+    *tifr &= ~(1 << OCF0A);       // cleared when the vector is executed
+    return true;
+  }
+  return false;
+}
+
+static const SimRegisterModel CONFIG_MODEL = { NULL, config_write };
+static const SimRegisterModel TIFR_MODEL = { NULL, tifr_write };
+
+void sim_timer0_reset(void) {
+  generation++;
+  sim_model(SIM_TCCR0A, &CONFIG_MODEL);
+  sim_model(SIM_TCCR0B, &CONFIG_MODEL);
+  sim_model(SIM_TCNT0, &CONFIG_MODEL);
+  sim_model(SIM_OCR0A, &CONFIG_MODEL);
+  sim_model(SIM_TIFR, &TIFR_MODEL);
+  sim_irq_source(SIM_VECTOR_TIMER0_COMPA, compare_pending);
+}
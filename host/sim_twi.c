@@ -0,0 +1,218 @@
+/***************************************************************
+ * Model of the TWI peripheral of the ATmega328P in master mode,
+ * on the same simulated two-wire bus as the USI model.
+ *
+ * The model works a byte at a time rather than bit by bit.
+ * Writing TWCR with TWINT set starts a start condition, stop
+ * condition, address byte or data byte, as selected by TWSTA,
+ * TWSTO and the state of the transfer, which completes on the
+ * virtual clock one SCL period later (nine for a byte with its
+ * acknowledge). The attached devices see the byte, and TWSR and
+ * TWINT are updated, when it completes. While sim_i2c_hold_scl
+ * holds SCL low, nothing completes.
+ *
+ * So that writing TWCR with the value it already holds is seen
+ * as a write, the reserved bit 1 of TWCR reads as one while
+ * TWINT is set. The slave modes, arbitration and TWWC are not
+ * modelled.
+ *
+ * @author Carl Harris
+ ***************************************************************/
+
+#include <stdint.h>
+
+#include <avr/io.h>
+#include <util/twi.h>
+
+#include "sim.h"
+
+#define TWCR_FLAG     (1 << 1)
+#define TWCR_WRITE    ((1 << TWEA) | (1 << TWSTA) | (1 << TWEN) | (1 << TWIE))
+
+typedef enum {
+    TWI_IDLE,             // the bus is free
+    TWI_ADDRESS,          // a start condition has been sent
+    TWI_TRANSMIT,         // a slave acknowledged its address for writing
+    TWI_RECEIVE,          // a slave acknowledged its address for reading
+    TWI_END               // only a start or stop condition may follow
+} TWIState;
+
+typedef enum {
+    OP_START,
+    OP_STOP,
+    OP_ADDRESS,
+    OP_WRITE,
+    OP_READ
+} TWIOperation;
+
+static TWIState state;
+static TWIOperation op;
+static bool busy;
+static bool ack;
+static uintptr_t generation;      // invalidates events when disabled
+static SimI2CDevice* selected;
+
+static uint64_t scl_period_ns(void) {
+  static const uint8_t PRESCALERS[] = { 1, 4, 16, 64 };
+  uint32_t cycles = 16 + 2 * (uint32_t) *sim_cell(SIM_TWBR)
+      * PRESCALERS[*sim_cell(SIM_TWSR) & 0x03];
+  return (uint64_t) cycles * 1000000000ULL / F_CPU;
+}
+
+static void end_transfer(void) {
+  if (selected != NULL && selected->stop != NULL) {
+    selected->stop(selected);
+  }
+  selected = NULL;
+}
+
+static void set_status(uint8_t status) {
+  uint8_t* twsr = sim_cell(SIM_TWSR);
+  *twsr = (*twsr & 0x03) | status;
+  *sim_cell(SIM_TWCR) |= (1 << TWINT) | TWCR_FLAG;
+}
+
+static void complete(void* ctx) {
+  if ((uintptr_t) ctx != generation) {
+    return;
+  }
+  if (sim_i2c_scl_held()) {
+    sim_at(sim_time_ns() + scl_period_ns(), complete, ctx);
+    return;
+  }
+  busy = false;
+  uint8_t data = *sim_cell(SIM_TWDR);
+  switch (op) {
+    case OP_START:
+      end_transfer();
+      sim_counts.twi_starts++;
+      set_status(state == TWI_IDLE ? TW_START : TW_REP_START);
+      state = TWI_ADDRESS;
+      break;
+
+    case OP_STOP:
+      end_transfer();
+      *sim_cell(SIM_TWCR) &= ~(1 << TWSTO);
+      state = TWI_IDLE;
+      break;
+
+    case OP_ADDRESS:
+      sim_counts.twi_bytes++;
+      selected = sim_i2c_find(data >> 1);
+      if (selected == NULL) {
+        sim_counts.twi_nacks++;
+        set_status((data & 0x01) ? TW_MR_SLA_NACK : TW_MT_SLA_NACK);
+        state = TWI_END;
+        break;
+      }
+      if (selected->start != NULL) {
+        selected->start(selected, data & 0x01);
+      }
+      set_status((data & 0x01) ? TW_MR_SLA_ACK : TW_MT_SLA_ACK);
+      state = (data & 0x01) ? TWI_RECEIVE : TWI_TRANSMIT;
+      break;
+
+    case OP_WRITE:
+      sim_counts.twi_bytes++;
+      if (selected->write(selected, data)) {
+        set_status(TW_MT_DATA_ACK);
+      }
+      else {
+        sim_counts.twi_nacks++;
+        set_status(TW_MT_DATA_NACK);
+        state = TWI_END;
+      }
+      break;
+
+    case OP_READ:
+      sim_counts.twi_bytes++;
+      *sim_cell(SIM_TWDR) = selected->read(selected);
+      set_status(ack ? TW_MR_DATA_ACK : TW_MR_DATA_NACK);
+      if (!ack) {
+        state = TWI_END;
+      }
+      break;
+  }
+}
+
+/**
+ * Starts the operation selected by a value written to TWCR.
+ */
+static void start_operation(uint8_t value) {
+  uint32_t periods = 1;
+  if (busy) {
+    sim_error("TWCR written while a TWI operation is in progress");
+    return;
+  }
+  if (value & (1 << TWSTO)) {
+    op = OP_STOP;
+  }
+  else if (value & (1 << TWSTA)) {
+    op = OP_START;
+  }
+  else {
+    switch (state) {
+      case TWI_ADDRESS:
+        op = OP_ADDRESS;
+        break;
+      case TWI_TRANSMIT:
+        op = OP_WRITE;
+        break;
+      case TWI_RECEIVE:
+        op = OP_READ;
+        break;
+      default:
+        sim_error("TWI byte transfer without a slave addressed");
+        return;
+    }
+    periods = 9;
+  }
+  busy = true;
+  ack = value & (1 << TWEA);
+  sim_at(sim_time_ns() + periods * scl_period_ns(), complete,
+      (void*) generation);
+}
+
+static void twcr_write(SimRegister r, uint8_t value, uint8_t old) {
+  uint8_t* twcr = sim_cell(r);
+  if (!(value & (1 << TWEN))) {
+    // disabling the TWI abandons any operation and releases the bus
+    generation++;
+    busy = false;
+    end_transfer();
+    state = TWI_IDLE;
+    *twcr = value & TWCR_WRITE;
+    return;
+  }
+  // TWINT is cleared by writing a one
+  uint8_t flag = (value & (1 << TWINT)) ?
+      0 : old & ((1 << TWINT) | TWCR_FLAG);
+  *twcr = (value & (TWCR_WRITE | (1 << TWSTO))) | flag;
+  if (value & (1 << TWINT)) {
+    start_operation(value);
+  }
+}
+
+static void twsr_write(SimRegister r, uint8_t value, uint8_t old) {
+  // only the prescaler bits are writable
+  *sim_cell(r) = (old & ~0x03) | (value & 0x03);
+}
+
+static bool twi_pending(void) {
+  uint8_t twcr = *sim_cell(SIM_TWCR);
+  return (twcr & (1 << TWIE)) && (twcr & (1 << TWINT));
+}
+
+static const SimRegisterModel TWCR_MODEL = { NULL, twcr_write };
+static const SimRegisterModel TWSR_MODEL = { NULL, twsr_write };
+
+void sim_twi_reset(void) {
+  state = TWI_IDLE;
+  busy = false;
+  selected = NULL;
+  generation++;
+  *sim_cell(SIM_TWSR) = TW_NO_INFO;
+  sim_model(SIM_TWCR, &TWCR_MODEL);
+  sim_model(SIM_TWSR, &TWSR_MODEL);
+  sim_irq_source(SIM_VECTOR_TWI, twi_pending);
+}
@@ -0,0 +1,208 @@
+/***************************************************************
+ * Model of USART0 of the ATmega328P in asynchronous mode.
+ *
+ * Frames take the time given by UBRR0, U2X0 and the frame format
+ * on the virtual clock. The transmitter has the data register and
+ * shift register of the hardware, so UDRE0 is set again as soon as
+ * a byte moves into the shift register; each attached device sees
+ * the byte when its frame ends. Bytes sent to the receiver with
+ * sim_uart_send arrive one frame apart into the two-byte receive
+ * buffer. An access to UDR0 while RXC0 is set is taken to be a read
+ * unless the code stores a different value.
+ *
+ * @author Carl Harris
+ ***************************************************************/
+
+#include <stdint.h>
+#include <avr/io.h>
+
+#include "sim.h"
+
+static SimUARTDevice* devices;
+
+static bool shifting;
+static uint8_t shift_data;
+static uint64_t shift_end;
+static bool buffered;
+static uint8_t buffer_data;
+
+static uint8_t rx_buffer[2];
+static uint8_t rx_count;
+static uint64_t rx_line_free;
+
+static uint64_t frame_ns(void) {
+  uint8_t a = *sim_cell(SIM_UCSR0A);
+  uint8_t b = *sim_cell(SIM_UCSR0B);
+  uint8_t c = *sim_cell(SIM_UCSR0C);
+  uint32_t ubrr = ((*sim_cell(SIM_UBRR0H) & 0x0F) << 8) | *sim_cell(SIM_UBRR0L);
+  uint32_t divider = ((a & (1 << U2X0)) ? 8 : 16) * (ubrr + 1);
+
+  uint8_t bits = 1                                  // start bit
+      + 5 + ((c >> UCSZ00) & 0x3) + ((b & (1 << UCSZ02)) ? 4 : 0)
+      + ((c & (1 << UPM01)) ? 1 : 0)                // parity bit
+      + ((c & (1 << USBS0)) ? 2 : 1);               // stop bits
+  if (bits > 13) {
+    bits = 13;
+  }
+  return (uint64_t) bits * divider * 1000000000ULL / F_CPU;
+}
+
+static void shift_done(void* ctx);
+
+static void start_shift(uint8_t data) {
+  shifting = true;
+  shift_data = data;
+  shift_end = sim_time_ns() + frame_ns();
+  sim_at(shift_end, shift_done, NULL);
+}
+
+static void shift_done(void* ctx) {
+  (void) ctx;
+  shifting = false;
+  for (SimUARTDevice* dev = devices; dev != NULL; dev = dev->next) {
+    dev->receive(dev, shift_data);
+  }
+  if (buffered) {
+    buffered = false;
+    *sim_cell(SIM_UCSR0A) |= (1 << UDRE0);
+    start_shift(buffer_data);
+  }
+  else {
+    *sim_cell(SIM_UCSR0A) |= (1 << TXC0);
+  }
+}
+
+static void rx_arrive(void* ctx) {
+  uint8_t data = (uint8_t) (uintptr_t) ctx;
+  if (!(*sim_cell(SIM_UCSR0B) & (1 << RXEN0))) {
+    return;
+  }
+  if (rx_count == sizeof(rx_buffer)) {
+    *sim_cell(SIM_UCSR0A) |= (1 << DOR0);
+    sim_error("USART receive overrun");
+    return;
+  }
+  rx_buffer[rx_count++] = data;
+  *sim_cell(SIM_UCSR0A) |= (1 << RXC0);
+  sim_counts.uart_rx_bytes++;
+}
+
+static bool udr_access(SimRegister r) {
+  uint8_t* ucsra = sim_cell(SIM_UCSR0A);
+  if (!(*ucsra & (1 << RXC0))) {
+    return true;
+  }
+  *sim_cell(r) = rx_buffer[0];
+  rx_buffer[0] = rx_buffer[1];
+  if (--rx_count == 0) {
+    *ucsra &= ~(1 << RXC0);
+  }
+  *ucsra &= ~(1 << DOR0);
+  return false;
+}
+
+static void udr_write(SimRegister r, uint8_t value, uint8_t old) {
+  (void) r;
+  (void) old;
+  uint8_t* ucsra = sim_cell(SIM_UCSR0A);
+  if (!(*sim_cell(SIM_UCSR0B) & (1 << TXEN0))) {
+    sim_error("UDR0 written with the transmitter disabled");
+    return;
+  }
+  if (!(*ucsra & (1 << UDRE0))) {
+    sim_error("UDR0 written while UDRE0 was clear");
+    return;
+  }
+  *ucsra &= ~(1 << TXC0);
+  sim_counts.uart_tx_bytes++;
+  if (!shifting) {
+    start_shift(value);
+  }
+  else {
+    buffered = true;
+    buffer_data = value;
+    *ucsra &= ~(1 << UDRE0);
+  }
+}
+
+static bool ucsra_access(SimRegister r) {
+  // polling for an empty data register waits for the shift register
+  if (!(*sim_cell(r) & (1 << UDRE0)) && shifting) {
+    sim_advance_to(shift_end);
+  }
+  return false;
+}
+
+static void ucsra_write(SimRegister r, uint8_t value, uint8_t old) {
+  uint8_t writable = (1 << U2X0) | (1 << MPCM0);
+  uint8_t state = (old & ~writable) | (value & writable);
+  if (value & (1 << TXC0)) {
+    state &= ~(1 << TXC0);        // cleared by writing a one
+  }
+  *sim_cell(r) = state;
+}
+
+static void ucsrb_write(SimRegister r, uint8_t value, uint8_t old) {
+  (void) r;
+  (void) old;
+  if (!(value & (1 << RXEN0))) {
+    rx_count = 0;
+    *sim_cell(SIM_UCSR0A) &= ~((1 << RXC0) | (1 << DOR0));
+  }
+}
+
+static bool rx_pending(void) {
+  return (*sim_cell(SIM_UCSR0B) & (1 << RXCIE0))
+      && (*sim_cell(SIM_UCSR0A) & (1 << RXC0));
+}
+
+static bool udre_pending(void) {
+  return (*sim_cell(SIM_UCSR0B) & (1 << UDRIE0))
+      && (*sim_cell(SIM_UCSR0A) & (1 << UDRE0));
+}
+
+static bool tx_pending(void) {
+  uint8_t* ucsra = sim_cell(SIM_UCSR0A);
+  if ((*sim_cell(SIM_UCSR0B) & (1 << TXCIE0)) && (*ucsra & (1 << TXC0))) {
+    *ucsra &= ~(1 << TXC0);
+    return true;
+  }
+  return false;
+}
+
+static const SimRegisterModel UDR_MODEL = { udr_access, udr_write };
+static const SimRegisterModel UCSRA_MODEL = { ucsra_access, ucsra_write };
+static const SimRegisterModel UCSRB_MODEL = { NULL, ucsrb_write };
+
+void sim_uart_attach(SimUARTDevice* dev) {
+  dev->next = devices;
+  devices = dev;
+}
+
+void sim_uart_send(const uint8_t* data, uint8_t length) {
+  uint64_t t = sim_time_ns();
+  if (rx_line_free > t) {
+    t = rx_line_free;
+  }
+  while (length-- != 0) {
+    t += frame_ns();
+    sim_at(t, rx_arrive, (void*) (uintptr_t) *data++);
+  }
+  rx_line_free = t;
+}
+
+void sim_usart_reset(void) {
+  devices = NULL;
+  shifting = false;
+  buffered = false;
+  rx_count = 0;
+  rx_line_free = 0;
+  *sim_cell(SIM_UCSR0A) = (1 << UDRE0);
+  *sim_cell(SIM_UCSR0C) = (1 << UCSZ01) | (1 << UCSZ00);
+  sim_model(SIM_UDR0, &UDR_MODEL);
+  sim_model(SIM_UCSR0A, &UCSRA_MODEL);
+  sim_model(SIM_UCSR0B, &UCSRB_MODEL);
+  sim_irq_source(SIM_VECTOR_USART_RX, rx_pending);
+  sim_irq_source(SIM_VECTOR_USART_UDRE, udre_pending);
+  sim_irq_source(SIM_VECTOR_USART_TX, tx_pending);
+}
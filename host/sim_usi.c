@@ -0,0 +1,367 @@
+/***************************************************************
+ * Model of the Universal Serial Interface (USI) of the ATtiny85
+ * in two-wire mode, and of the I2C bus connected to its pins.
+ *
+ * The bus lines are the wired AND of the levels driven by the
+ * microcontroller and by the devices on the bus, with pull-up
+ * resistors. In two-wire mode SDA is pulled low when PORTB0 or
+ * the output latch (bit 7 of USIDR, transparent while SCL is low)
+ * is zero, and SCL is pulled low when PORTB2 is zero or the USI
+ * holds it. Edges on SCL shift USIDR and clock the USI counter
+ * according to USICS1:0 and USICLK, as does writing USICLK with
+ * USICS1:0 clear (the software clock strobe), and a start condition
+ * sets USISIF.
+ *
+ * The bus model handles the bit-level protocol for byte-oriented
+ * devices: it detects start and stop conditions, shifts address
+ * and data bits, and drives SDA for acknowledge bits and for data
+ * read by the master. The devices do not stretch the clock, but
+ * sim_i2c_hold_scl holds SCL low as a stretching slave would. The
+ * USIPF and USIDC flags are not modelled.
+ *
+ * @author Carl Harris
+ ***************************************************************/
+
+#include <avr/io.h>
+
+#include "sim.h"
+
+#define SDA   (1 << PB0)
+#define SCL   (1 << PB2)
+
+typedef enum {
+    BUS_IDLE,             // waiting for a start condition
+    BUS_ADDRESS,          // receiving the address byte
+    BUS_RECEIVE,          // receiving a data byte
+    BUS_ACK,              // acknowledging an address or data byte
+    BUS_TRANSMIT,         // sending a data byte
+    BUS_ACK_IN            // receiving the master's acknowledge
+} BusState;
+
+static SimI2CDevice* devices;
+static SimI2CDevice* selected;
+static BusState state;
+static uint8_t shift;
+static uint8_t bits;
+static bool acked;
+static bool reading;
+static bool master_ack;
+static bool device_sda_low;
+
+static bool scl_line;
+static bool sda_line;
+static bool latch;
+static bool scl_held;             // by sim_i2c_hold_scl
+static SimWatch port_watch;
+static SimWatch ddr_watch;
+
+static void bus_start(void) {
+  if (selected != NULL && selected->stop != NULL) {
+    selected->stop(selected);
+  }
+  selected = NULL;
+  state = BUS_ADDRESS;
+  shift = 0;
+  bits = 0;
+  device_sda_low = false;
+  sim_counts.twi_starts++;
+}
+
+static void bus_stop(void) {
+  if (selected != NULL && selected->stop != NULL) {
+    selected->stop(selected);
+  }
+  selected = NULL;
+  state = BUS_IDLE;
+  device_sda_low = false;
+}
+
+static void bus_transmit_byte(void) {
+  shift = selected->read(selected);
+  device_sda_low = !(shift & 0x80);
+  bits = 1;
+  state = BUS_TRANSMIT;
+}
+
+static void bus_scl_rise(void) {
+  switch (state) {
+    case BUS_ADDRESS:
+    case BUS_RECEIVE:
+      shift = (shift << 1) | (sda_line ? 1 : 0);
+      bits++;
+      break;
+    case BUS_ACK_IN:
+      master_ack = !sda_line;
+      break;
+    default:
+      break;
+  }
+}
+
+static void bus_scl_fall(void) {
+  switch (state) {
+    case BUS_ADDRESS:
+      if (bits < 8) {
+        break;
+      }
+      sim_counts.twi_bytes++;
+      selected = sim_i2c_find(shift >> 1);
+      if (selected == NULL) {
+        sim_counts.twi_nacks++;
+        state = BUS_IDLE;
+        break;
+      }
+      reading = shift & 0x01;
+      if (selected->start != NULL) {
+        selected->start(selected, reading);
+      }
+      acked = true;
+      device_sda_low = true;
+      state = BUS_ACK;
+      break;
+
+    case BUS_RECEIVE:
+      if (bits < 8) {
+        break;
+      }
+      sim_counts.twi_bytes++;
+      acked = selected->write(selected, shift);
+      if (!acked) {
+        sim_counts.twi_nacks++;
+      }
+      device_sda_low = acked;
+      state = BUS_ACK;
+      break;
+
+    case BUS_ACK:
+      device_sda_low = false;
+      if (!acked) {
+        state = BUS_IDLE;
+      }
+      else if (reading) {
+        bus_transmit_byte();
+      }
+      else {
+        shift = 0;
+        bits = 0;
+        state = BUS_RECEIVE;
+      }
+      break;
+
+    case BUS_TRANSMIT:
+      if (bits < 8) {
+        device_sda_low = !((shift << bits) & 0x80);
+        bits++;
+      }
+      else {
+        device_sda_low = false;
+        sim_counts.twi_bytes++;
+        state = BUS_ACK_IN;
+      }
+      break;
+
+    case BUS_ACK_IN:
+      if (master_ack) {
+        bus_transmit_byte();
+      }
+      else {
+        state = BUS_IDLE;
+      }
+      break;
+
+    default:
+      break;
+  }
+}
+
+static void usi_count(void) {
+  uint8_t* usisr = sim_cell(SIM_USISR);
+  uint8_t count = (*usisr + 1) & 0x0F;
+  *usisr = (*usisr & 0xF0) | count;
+  if (count == 0) {
+    *usisr |= (1 << USIOIF);
+  }
+}
+
+static bool two_wire(void) {
+  return *sim_cell(SIM_USICR) & (1 << USIWM1);
+}
+
+/*
+ * The USI keeps SCL low, once it has fallen, after a start condition
+ * and (with USIWM0 set) after a counter overflow, until the flag is
+ * cleared.
+ */
+static bool usi_holds_scl(void) {
+  uint8_t usicr = *sim_cell(SIM_USICR);
+  uint8_t usisr = *sim_cell(SIM_USISR);
+  return two_wire() && !scl_line && ((usisr & (1 << USISIF))
+      || ((usicr & (1 << USIWM0)) && (usisr & (1 << USIOIF))));
+}
+
+static void usi_scl_edge(bool rising) {
+  uint8_t usicr = *sim_cell(SIM_USICR);
+  if (!two_wire() || !(usicr & (1 << USICS1))) {
+    return;
+  }
+  // USICS0 selects the edge on which the data register shifts
+  if (rising == !(usicr & (1 << USICS0))) {
+    uint8_t* usidr = sim_cell(SIM_USIDR);
+    *usidr = (*usidr << 1) | (sda_line ? 1 : 0);
+  }
+  if (!(usicr & (1 << USICLK))) {
+    usi_count();                    // counter clocked by both edges
+  }
+}
+
+/**
+ * Recomputes the bus lines from everything that drives them, and acts
+ * on each edge, until the lines are stable.
+ */
+static void bus_update(void) {
+  for (;;) {
+    uint8_t ddr = *sim_cell(SIM_DDRB);
+    uint8_t port = *sim_cell(SIM_PORTB);
+
+    bool scl = !(scl_held
+        || ((ddr & SCL) && (!(port & SCL) || usi_holds_scl())));
+    if (scl != scl_line) {
+      scl_line = scl;
+      usi_scl_edge(scl);
+      if (scl) {
+        bus_scl_rise();
+      }
+      else {
+        bus_scl_fall();
+      }
+      continue;
+    }
+
+    // the latch is open while SCL is low, or always with an internal clock
+    if (!scl_line || !(*sim_cell(SIM_USICR) & (1 << USICS1))) {
+      latch = *sim_cell(SIM_USIDR) & 0x80;
+    }
+    bool sda = !(device_sda_low
+        || ((ddr & SDA) && (!(port & SDA) || (two_wire() && !latch))));
+    if (sda != sda_line) {
+      sda_line = sda;
+      if (scl_line && !sda) {
+        if (two_wire()) {
+          *sim_cell(SIM_USISR) |= (1 << USISIF);
+        }
+        bus_start();
+      }
+      else if (scl_line) {
+        bus_stop();
+      }
+      continue;
+    }
+    break;
+  }
+  sim_pin_input(SIM_PORTB, SDA | SCL, (sda_line ? SDA : 0) | (scl_line ? SCL : 0));
+}
+
+static void port_changed(SimRegister r, uint8_t value, uint8_t old, void* ctx) {
+  (void) r;
+  (void) value;
+  (void) old;
+  (void) ctx;
+  bus_update();
+}
+
+static void usicr_write(SimRegister r, uint8_t value, uint8_t old) {
+  (void) old;
+  if ((value & (1 << USICLK)) && !(value & ((1 << USICS1) | (1 << USICS0)))) {
+    // a software clock strobe shifts the data register and clocks the
+    // counter, without changing SCL
+    *sim_cell(r) = value & ~(1 << USICLK);
+    uint8_t* usidr = sim_cell(SIM_USIDR);
+    *usidr = (*usidr << 1) | (sda_line ? 1 : 0);
+    usi_count();
+  }
+  if (value & (1 << USITC)) {
+    // the strobe toggles SCL, and clocks the counter if USICLK is set
+    *sim_cell(r) = value & ~(1 << USITC);
+    if ((value & (1 << USICS1)) && (value & (1 << USICLK))) {
+      usi_count();
+    }
+    uint8_t* port = sim_cell(SIM_PORTB);
+    uint8_t previous = *port;
+    *port ^= SCL;
+    sim_port_written(SIM_PORTB, previous);
+  }
+  bus_update();
+}
+
+static void usisr_write(SimRegister r, uint8_t value, uint8_t old) {
+  // flags are cleared by writing a one; the counter is written directly
+  *sim_cell(r) = (old & 0xF0 & ~value) | (value & 0x0F);
+  bus_update();
+}
+
+static void usidr_write(SimRegister r, uint8_t value, uint8_t old) {
+  (void) r;
+  (void) value;
+  (void) old;
+  bus_update();
+}
+
+static bool start_pending(void) {
+  return (*sim_cell(SIM_USICR) & (1 << USISIE))
+      && (*sim_cell(SIM_USISR) & (1 << USISIF));
+}
+
+static bool overflow_pending(void) {
+  return (*sim_cell(SIM_USICR) & (1 << USIOIE))
+      && (*sim_cell(SIM_USISR) & (1 << USIOIF));
+}
+
+static const SimRegisterModel USICR_MODEL = { NULL, usicr_write };
+static const SimRegisterModel USISR_MODEL = { NULL, usisr_write };
+static const SimRegisterModel USIDR_MODEL = { NULL, usidr_write };
+
+void sim_i2c_attach(SimI2CDevice* dev) {
+  dev->next = devices;
+  devices = dev;
+}
+
+SimI2CDevice* sim_i2c_find(uint8_t address) {
+  for (SimI2CDevice* dev = devices; dev != NULL; dev = dev->next) {
+    if (dev->address == address) {
+      return dev;
+    }
+  }
+  return NULL;
+}
+
+bool sim_i2c_scl_held(void) {
+  return scl_held;
+}
+
+void sim_i2c_hold_scl(bool hold) {
+  sim_sync();
+  scl_held = hold;
+  bus_update();
+}
+
+void sim_usi_reset(void) {
+  devices = NULL;
+  selected = NULL;
+  state = BUS_IDLE;
+  device_sda_low = false;
+  scl_held = false;
+  scl_line = true;
+  sda_line = true;
+  latch = true;
+
+  port_watch.changed = port_changed;
+  ddr_watch.changed = port_changed;
+  sim_watch(SIM_PORTB, &port_watch);
+  sim_watch(SIM_DDRB, &ddr_watch);
+  sim_model(SIM_USICR, &USICR_MODEL);
+  sim_model(SIM_USISR, &USISR_MODEL);
+  sim_model(SIM_USIDR, &USIDR_MODEL);
+  sim_irq_source(SIM_VECTOR_USI_START, start_pending);
+  sim_irq_source(SIM_VECTOR_USI_OVF, overflow_pending);
+  sim_pin_input(SIM_PORTB, SDA | SCL, SDA | SCL);
+}
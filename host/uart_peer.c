@@ -0,0 +1,48 @@
+/***************************************************************
+ * A peer on the simulated USART.
+ *
+ * @author Carl Harris
+ ***************************************************************/
+
+#include <string.h>
+
+#include "uart_peer.h"
+
+static void receive(SimUARTDevice* dev, uint8_t data) {
+  UARTPeer* p = (UARTPeer*) dev;
+  if (p->length < UART_PEER_BUFFER_SIZE - 1) {
+    p->received[p->length++] = data;
+    p->received[p->length] = 0;
+  }
+  else {
+    p->dropped++;
+  }
+}
+
+void uart_peer_init(UARTPeer* p) {
+  memset(p, 0, sizeof(*p));
+  p->uart.receive = receive;
+  sim_uart_attach(&p->uart);
+}
+
+void uart_peer_send(UARTPeer* p, const char* s) {
+  (void) p;
+  size_t length = strlen(s);
+  while (length != 0) {
+    uint8_t n = length > 255 ? 255 : length;
+    sim_uart_send((const uint8_t*) s, n);
+    s += n;
+    length -= n;
+  }
+}
+
+const char* uart_peer_received(UARTPeer* p) {
+  sim_sync();
+  return p->received;
+}
+
+void uart_peer_clear(UARTPeer* p) {
+  sim_sync();
+  p->length = 0;
+  p->received[0] = 0;
+}
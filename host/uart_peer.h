@@ -0,0 +1,48 @@
+/***************************************************************
+ * A peer on the simulated USART: records what the microcontroller
+ * transmits, and sends bytes to its receiver.
+ *
+ * @author Carl Harris
+ ***************************************************************/
+
+#ifndef UART_PEER_H
+#define UART_PEER_H
+
+#include <stdint.h>
+
+#include "sim.h"
+
+#ifndef UART_PEER_BUFFER_SIZE
+#define UART_PEER_BUFFER_SIZE   256
+#endif
+
+typedef struct {
+    SimUARTDevice uart;
+    char received[UART_PEER_BUFFER_SIZE];
+    uint16_t length;            /* bytes in received */
+    uint32_t dropped;           /* bytes that did not fit */
+} UARTPeer;
+
+/**
+ * Initializes the peer and attaches it to the USART.
+ */
+void uart_peer_init(UARTPeer* p);
+
+/**
+ * Sends a string to the microcontroller's receiver. The characters
+ * arrive one frame apart on the virtual clock.
+ */
+void uart_peer_send(UARTPeer* p, const char* s);
+
+/**
+ * Gets the characters received from the microcontroller so far.
+ * @return null-terminated string of the characters received
+ */
+const char* uart_peer_received(UARTPeer* p);
+
+/**
+ * Discards the characters received so far.
+ */
+void uart_peer_clear(UARTPeer* p);
+
+#endif /* UART_PEER_H */
@@ -18,6 +18,13 @@
 
 #include "lcd.h"
 
+#ifdef LCD_TRACE
+#include "trace.h"
+#else
+#define TRACE_ENTER(event)
+#define TRACE_EXIT(event)
+#endif
+
 /* LCD to GPIO interface definitions */
 #define LCD_RS 0x1      /* register select (data=1/command=0) */
 #define LCD_RW 0x2      /* read=1/write=0 */
@@ -80,11 +87,13 @@
  */
 static void lcd_write_nibble(LCD* lcd, uint8_t b, uint8_t rs_flag) {
   uint8_t output = (b << 4) | lcd->backlight | rs_flag;
+  TRACE_ENTER(TRACE_LCD_NIBBLE);
   lcd_write(lcd, output);
   delay_us(1);
   lcd_write(lcd, output | LCD_E);
   delay_us(1);
   lcd_write(lcd, output);
+  TRACE_EXIT(TRACE_LCD_NIBBLE);
   delay_us(100);
 }
 
@@ -108,26 +117,65 @@ void lcd_write_data(LCD* lcd, uint8_t d) {
   lcd_write_nibble(lcd, d & 0xf, LCD_DATA);
 }
 
+/**
+ * Waits for a time that is not known at compile time.
+ * @param us time to wait in microseconds
+ */
+static void lcd_wait(uint16_t us) {
+  while (us >= 100) {
+    delay_us(100);
+    us -= 100;
+  }
+  while (us-- != 0) {
+    delay_us(1);
+  }
+}
+
 void lcd_init(LCD* lcd) {
+  uint16_t us;
+  lcd_init_begin(lcd);
+  while ((us = lcd_init_step(lcd)) != LCD_DONE) {
+    lcd_wait(us);
+  }
+}
+
+void lcd_init_begin(LCD* lcd) {
   lcd->backlight = LCD_BL;
-  delay_us(50000);
-  lcd->write(lcd->ctx, 0);
-
-  lcd_write_nibble(lcd, 0x3, 0);
-  delay_us(4500);
-  lcd_write_nibble(lcd, 0x3, 0);
-  delay_us(4500);
-  lcd_write_nibble(lcd, 0x3, 0);
-  delay_us(150);
-  lcd_write_nibble(lcd, 0x2, 0);
-
-  lcd_write_command(lcd, LCD_FUNCTIONSET | LCD_2LINE);
-  lcd->displayControl = LCD_DISPLAY_ON;
-  lcd_write_command(lcd, LCD_DISPLAYCONTROL | lcd->displayControl);
-  lcd->displayMode = LCD_ENTRYLEFT;
-  lcd_write_command(lcd, LCD_ENTRYMODESET | lcd->displayMode);
-  lcd_write_command(lcd, LCD_CLEARDISPLAY);
-  delay_us(2000);
+  lcd->step = 0;
+}
+
+uint16_t lcd_init_step(LCD* lcd) {
+  switch (lcd->step++) {
+    case 0:
+      return 50000;               // power on
+
+    case 1:
+      lcd->write(lcd->ctx, 0);
+      lcd_write_nibble(lcd, 0x3, 0);
+      return 4500;
+
+    case 2:
+      lcd_write_nibble(lcd, 0x3, 0);
+      return 4500;
+
+    case 3:
+      lcd_write_nibble(lcd, 0x3, 0);
+      return 150;
+
+    case 4:
+      lcd_write_nibble(lcd, 0x2, 0);
+      lcd_write_command(lcd, LCD_FUNCTIONSET | LCD_2LINE);
+      lcd->displayControl = LCD_DISPLAY_ON;
+      lcd_write_command(lcd, LCD_DISPLAYCONTROL | lcd->displayControl);
+      lcd->displayMode = LCD_ENTRYLEFT;
+      lcd_write_command(lcd, LCD_ENTRYMODESET | lcd->displayMode);
+      lcd_write_command(lcd, LCD_CLEARDISPLAY);
+      return 2000;
+
+    default:
+      lcd->step = 5;
+      return LCD_DONE;
+  }
 }
 
 void lcd_backlight_off(LCD* lcd) {
@@ -39,8 +39,14 @@ typedef struct {
     uint8_t displayMode;       /* current state of the Entry Mode Set flags */
     LCDWrite write;            /* Write function pointer */
     uint8_t ctx;               /* Context for the write function */
+    uint8_t step;              /* next step of lcd_init_step */
 } LCD;
 
+/**
+ * Value returned by lcd_init_step when initialization is complete.
+ */
+#define LCD_DONE 0xFFFF
+
 
 /**
  * Initializes the LCD controller using the procedure described
@@ -51,6 +57,26 @@ typedef struct {
  */
 void lcd_init(LCD* lcd);
 
+/**
+ * Starts initializing the LCD controller without blocking, for use
+ * with a cooperative scheduler. Call lcd_init_step until it returns
+ * LCD_DONE, waiting at least the time it returns between calls; the
+ * LCD must not otherwise be used until then.
+ *
+ * @param lcd LCD context
+ */
+void lcd_init_begin(LCD* lcd);
+
+/**
+ * Performs the next step of the initialization started by 
+ * lcd_init_begin.
+ *
+ * @param lcd LCD context
+ * @return time (in microseconds) to wait before the next step, or 
+ *      LCD_DONE if initialization is complete
+ */
+uint16_t lcd_init_step(LCD* lcd);
+
 /**
  * Turns off the backlight.
  * @param lcd LCD context
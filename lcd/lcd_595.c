@@ -0,0 +1,101 @@
+/***************************************************************
+ * Transport for the lcd module that drives the HD44780 through a
+ * 74HC595 shift register on the hardware SPI.
+ *
+ * @author Carl Harris
+ ***************************************************************/
+
+#include <avr/io.h>
+#include <util/delay.h>
+#define delay_us(us)  (_delay_us(us))
+
+#include "lcd_595.h"
+#include "spi.h"
+
+#if !defined(LCD_595_DDR) | !defined(LCD_595_PORT) | !defined(LCD_595_MASK)
+#define LCD_595_DDR DDRB
+#define LCD_595_PORT PORTB
+#define LCD_595_MASK _BV(PB1)
+#endif
+
+/* LCDWrite bits and the command used by the fast path */
+#define LCD_595_RS  0x1
+#define LCD_595_E   0x4
+#define LCD_595_SETDDRAMADDR 0x80
+
+/* a rising edge on RCLK copies the shift register to the outputs */
+#define LCD_595_LATCH() { \
+    LCD_595_PORT |= LCD_595_MASK; \
+    LCD_595_PORT &= ~LCD_595_MASK; \
+}
+
+static void lcd_595_shift(uint8_t r) {
+  spi_transfer(r);
+  LCD_595_LATCH();
+}
+
+void lcd_595_init(void) {
+  LCD_595_PORT &= ~LCD_595_MASK;
+  LCD_595_DDR |= LCD_595_MASK;
+}
+
+int lcd_595_write(uint8_t ctx, uint8_t r) {
+  (void) ctx;
+  lcd_595_shift(r);
+  return 0;
+}
+
+/**
+ * Sets up RS and the data lines for the first byte of a block, so
+ * that E can rise on the next byte shifted out.
+ * @param control control bits for each byte of the block
+ * @param b the first byte
+ */
+static void lcd_595_begin(uint8_t control, uint8_t b) {
+  lcd_595_shift((b & 0xf0) | control);
+}
+
+/**
+ * Writes a byte and waits for the controller to execute it. E rises
+ * with the data lines of each nibble, which is allowed because RS is
+ * already set up, and falls with the data lines unchanged.
+ * @param control control bits given to lcd_595_begin
+ * @param b the byte
+ */
+static void lcd_595_byte(uint8_t control, uint8_t b) {
+  uint8_t high = (b & 0xf0) | control;
+  uint8_t low = (uint8_t) (b << 4) | control;
+  lcd_595_shift(high | LCD_595_E);
+  lcd_595_shift(high);
+  lcd_595_shift(low | LCD_595_E);
+  lcd_595_shift(low);
+  delay_us(LCD_595_WAIT_US);
+}
+
+void lcd_595_goto(LCD* lcd, uint8_t x, uint8_t y) {
+  uint8_t c = LCD_595_SETDDRAMADDR | ((y & 0x1) << 6) | (x & 0x3f);
+  lcd_595_begin(lcd->backlight, c);
+  lcd_595_byte(lcd->backlight, c);
+}
+
+void lcd_595_write_data(LCD* lcd, const char* data, uint8_t length) {
+  if (length == 0) {
+    return;
+  }
+  uint8_t control = lcd->backlight | LCD_595_RS;
+  lcd_595_begin(control, data[0]);
+  while (length-- != 0) {
+    lcd_595_byte(control, *data++);
+  }
+}
+
+void lcd_595_puts(LCD* lcd, const char* s) {
+  if (*s == 0) {
+    return;
+  }
+  uint8_t control = lcd->backlight | LCD_595_RS;
+  lcd_595_begin(control, *s);
+  while (*s != 0) {
+    lcd_595_byte(control, *s++);
+  }
+}
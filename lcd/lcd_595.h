@@ -0,0 +1,74 @@
+/***************************************************************
+ * Transport for the lcd module that drives the HD44780 through a
+ * 74HC595 shift register on the hardware SPI, using three pins:
+ * MOSI, SCK and a latch pin connected to the register's RCLK.
+ *
+ * Each byte in the layout described by LCDWrite is shifted out
+ * and then latched onto the register's outputs, so QA..QH drive
+ * RS, RW, E, the backlight and D4..D7 respectively.
+ *
+ * @author Carl Harris
+ ***************************************************************/
+
+#ifndef LCD_595_H
+#define LCD_595_H
+
+#include <stdint.h>
+
+#include "lcd.h"
+
+/*
+ * Time (in microseconds) to wait after each character or command
+ * written by the fast path. At its nominal 270 kHz clock the HD44780
+ * takes 41 us to write a character and 37 us to set the cursor
+ * position; the default allows for a controller that runs somewhat
+ * slower.
+ */
+#ifndef LCD_595_WAIT_US
+#define LCD_595_WAIT_US   50
+#endif
+
+/**
+ * Configures the latch pin as an output. The SPI must be initialized
+ * and enabled separately, using spi_init and spi_enable.
+ */
+void lcd_595_init(void);
+
+/**
+ * An LCDWrite function that shifts a byte into the 74HC595 and
+ * latches it onto the outputs.
+ * @param ctx ignored
+ * @param r byte in the layout described by LCDWrite
+ * @return zero
+ */
+int lcd_595_write(uint8_t ctx, uint8_t r);
+
+/**
+ * Positions the cursor as lcd_goto does, using the same fast path as
+ * lcd_595_write_data.
+ * @param lcd LCD context, whose write function is lcd_595_write
+ * @param column zero-based column number
+ * @param row zero-based row number
+ */
+void lcd_595_goto(LCD* lcd, uint8_t column, uint8_t row);
+
+/**
+ * Writes characters to the display at the current cursor position,
+ * as lcd_puts does, but shifts out each character with four bytes
+ * back to back and waits only LCD_595_WAIT_US after it, rather than
+ * taking the generic path of six writes and two 100 us delays.
+ * @param lcd LCD context, whose write function is lcd_595_write
+ * @param data the characters to write
+ * @param length number of characters to write
+ */
+void lcd_595_write_data(LCD* lcd, const char* data, uint8_t length);
+
+/**
+ * Writes a string to the display at the current cursor position,
+ * using the same fast path as lcd_595_write_data.
+ * @param lcd LCD context, whose write function is lcd_595_write
+ * @param s the string to write
+ */
+void lcd_595_puts(LCD* lcd, const char* s);
+
+#endif /* LCD_595_H */
@@ -4,6 +4,13 @@
 #include "max7221.h"
 #include "spi.h"
 
+#ifdef MAX7221_TRACE
+#include "trace.h"
+#else
+#define TRACE_ENTER(event)
+#define TRACE_EXIT(event)
+#endif
+
 #if !defined(MAX7221_DDR) | !defined(MAX7221_PORT) | !defined(MAX7221_MASK)
 #define MAX7221_DDR DDRB
 #define MAX7221_PORT PORTB
@@ -13,6 +20,28 @@
 #define MAX7221_TEST_DELAY_MS       1000
 #define MAX7221_PATTERN_DELAY_MS    75
 
+#define MAX7221_TEST_TICKS      (MAX7221_TEST_DELAY_MS / MAX7221_ANIM_TICK_MS)
+#define MAX7221_PATTERN_TICKS   (MAX7221_PATTERN_DELAY_MS / MAX7221_ANIM_TICK_MS)
+
+// tick counts are stored in a byte, and every pattern frame needs a tick
+#if MAX7221_TEST_TICKS > 255 || MAX7221_PATTERN_TICKS < 1
+#error "MAX7221_ANIM_TICK_MS must be from 4 to 75"
+#endif
+
+#define MAX7221_NOOP                0x00
+#define MAX7221_DECODE_MODE         0x09
+#define MAX7221_DISPLAY_TEST        0x0F
+
+#define MAX7221_CODE_B_DASH         0x0A
+#define MAX7221_CODE_B_BLANK        0x0F
+#define MAX7221_POINT               0x80
+
+#define MAX7221_UDEC_MAX            99999999UL
+#define MAX7221_SDEC_MAX            9999999UL
+
+#define MAX7221_SELECT()    (MAX7221_PORT &= ~MAX7221_MASK)
+#define MAX7221_DESELECT()  (MAX7221_PORT |= MAX7221_MASK)
+
 
 const uint8_t PATTERNS[] PROGMEM = {
         0b01111110,
@@ -33,15 +62,276 @@ const uint8_t PATTERNS[] PROGMEM = {
         0b01000111,
 };
 
+const MAX7221Frame SNAKE_FRAMES[] PROGMEM = {
+        {{ 0x40, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, MAX7221_PATTERN_TICKS },
+        {{ 0x40, 0x40, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, MAX7221_PATTERN_TICKS },
+        {{ 0x40, 0x40, 0x40, 0x00, 0x00, 0x00, 0x00, 0x00 }, MAX7221_PATTERN_TICKS },
+        {{ 0x40, 0x40, 0x40, 0x40, 0x00, 0x00, 0x00, 0x00 }, MAX7221_PATTERN_TICKS },
+        {{ 0x40, 0x40, 0x40, 0x40, 0x40, 0x00, 0x00, 0x00 }, MAX7221_PATTERN_TICKS },
+        {{ 0x40, 0x40, 0x40, 0x40, 0x40, 0x40, 0x00, 0x00 }, MAX7221_PATTERN_TICKS },
+        {{ 0x40, 0x40, 0x40, 0x40, 0x40, 0x40, 0x40, 0x00 }, MAX7221_PATTERN_TICKS },
+        {{ 0x40, 0x40, 0x40, 0x40, 0x40, 0x40, 0x40, 0x40 }, MAX7221_PATTERN_TICKS },
+        {{ 0x40, 0x40, 0x40, 0x40, 0x40, 0x40, 0x40, 0x60 }, MAX7221_PATTERN_TICKS },
+        {{ 0x40, 0x40, 0x40, 0x40, 0x40, 0x40, 0x40, 0x61 }, MAX7221_PATTERN_TICKS },
+        {{ 0x40, 0x40, 0x40, 0x40, 0x40, 0x40, 0x41, 0x61 }, MAX7221_PATTERN_TICKS },
+        {{ 0x40, 0x40, 0x40, 0x40, 0x40, 0x41, 0x41, 0x61 }, MAX7221_PATTERN_TICKS },
+        {{ 0x40, 0x40, 0x40, 0x40, 0x41, 0x41, 0x41, 0x61 }, MAX7221_PATTERN_TICKS },
+        {{ 0x40, 0x40, 0x40, 0x41, 0x41, 0x41, 0x41, 0x61 }, MAX7221_PATTERN_TICKS },
+        {{ 0x40, 0x40, 0x41, 0x41, 0x41, 0x41, 0x41, 0x61 }, MAX7221_PATTERN_TICKS },
+        {{ 0x40, 0x41, 0x41, 0x41, 0x41, 0x41, 0x41, 0x61 }, MAX7221_PATTERN_TICKS },
+        {{ 0x41, 0x41, 0x41, 0x41, 0x41, 0x41, 0x41, 0x61 }, MAX7221_PATTERN_TICKS },
+        {{ 0x45, 0x41, 0x41, 0x41, 0x41, 0x41, 0x41, 0x61 }, MAX7221_PATTERN_TICKS },
+        {{ 0x4d, 0x41, 0x41, 0x41, 0x41, 0x41, 0x41, 0x61 }, MAX7221_PATTERN_TICKS },
+        {{ 0x4d, 0x49, 0x41, 0x41, 0x41, 0x41, 0x41, 0x61 }, MAX7221_PATTERN_TICKS },
+        {{ 0x4d, 0x49, 0x49, 0x41, 0x41, 0x41, 0x41, 0x61 }, MAX7221_PATTERN_TICKS },
+        {{ 0x4d, 0x49, 0x49, 0x49, 0x41, 0x41, 0x41, 0x61 }, MAX7221_PATTERN_TICKS },
+        {{ 0x4d, 0x49, 0x49, 0x49, 0x49, 0x41, 0x41, 0x61 }, MAX7221_PATTERN_TICKS },
+        {{ 0x4d, 0x49, 0x49, 0x49, 0x49, 0x49, 0x41, 0x61 }, MAX7221_PATTERN_TICKS },
+        {{ 0x4d, 0x49, 0x49, 0x49, 0x49, 0x49, 0x49, 0x61 }, MAX7221_PATTERN_TICKS },
+        {{ 0x0d, 0x09, 0x49, 0x49, 0x49, 0x49, 0x49, 0x69 }, MAX7221_PATTERN_TICKS },
+        {{ 0x0d, 0x09, 0x09, 0x49, 0x49, 0x49, 0x49, 0x69 }, MAX7221_PATTERN_TICKS },
+        {{ 0x0d, 0x09, 0x09, 0x09, 0x49, 0x49, 0x49, 0x69 }, MAX7221_PATTERN_TICKS },
+        {{ 0x0d, 0x09, 0x09, 0x09, 0x09, 0x49, 0x49, 0x69 }, MAX7221_PATTERN_TICKS },
+        {{ 0x0d, 0x09, 0x09, 0x09, 0x09, 0x09, 0x49, 0x69 }, MAX7221_PATTERN_TICKS },
+        {{ 0x0d, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x69 }, MAX7221_PATTERN_TICKS },
+        {{ 0x0d, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x29 }, MAX7221_PATTERN_TICKS },
+        {{ 0x0d, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09 }, MAX7221_PATTERN_TICKS },
+        {{ 0x0d, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x08 }, MAX7221_PATTERN_TICKS },
+        {{ 0x0d, 0x09, 0x09, 0x09, 0x09, 0x09, 0x08, 0x08 }, MAX7221_PATTERN_TICKS },
+        {{ 0x0d, 0x09, 0x09, 0x09, 0x09, 0x08, 0x08, 0x08 }, MAX7221_PATTERN_TICKS },
+        {{ 0x0d, 0x09, 0x09, 0x09, 0x08, 0x08, 0x08, 0x08 }, MAX7221_PATTERN_TICKS },
+        {{ 0x0d, 0x09, 0x09, 0x08, 0x08, 0x08, 0x08, 0x08 }, MAX7221_PATTERN_TICKS },
+        {{ 0x0d, 0x09, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08 }, MAX7221_PATTERN_TICKS },
+        {{ 0x0d, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08 }, MAX7221_PATTERN_TICKS },
+        {{ 0x0c, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08 }, MAX7221_PATTERN_TICKS },
+        {{ 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08 }, MAX7221_PATTERN_TICKS },
+        {{ 0x00, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08 }, MAX7221_PATTERN_TICKS },
+        {{ 0x00, 0x00, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08 }, MAX7221_PATTERN_TICKS },
+        {{ 0x00, 0x00, 0x00, 0x08, 0x08, 0x08, 0x08, 0x08 }, MAX7221_PATTERN_TICKS },
+        {{ 0x00, 0x00, 0x00, 0x00, 0x08, 0x08, 0x08, 0x08 }, MAX7221_PATTERN_TICKS },
+        {{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x08, 0x08, 0x08 }, MAX7221_PATTERN_TICKS },
+        {{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x08, 0x08 }, MAX7221_PATTERN_TICKS },
+        {{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x08 }, MAX7221_PATTERN_TICKS },
+        {{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, MAX7221_PATTERN_TICKS },
+};
+
+const MAX7221Frame SPIN_FRAMES[] PROGMEM = {
+        {{ 0xc0, 0x40, 0x40, 0x40, 0x40, 0x40, 0x40, 0x40 }, MAX7221_PATTERN_TICKS },
+        {{ 0xa0, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20 }, MAX7221_PATTERN_TICKS },
+        {{ 0x90, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10 }, MAX7221_PATTERN_TICKS },
+        {{ 0x88, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08 }, MAX7221_PATTERN_TICKS },
+        {{ 0x84, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04 }, MAX7221_PATTERN_TICKS },
+        {{ 0x82, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02 }, MAX7221_PATTERN_TICKS },
+        {{ 0x40, 0xc0, 0x40, 0x40, 0x40, 0x40, 0x40, 0x40 }, MAX7221_PATTERN_TICKS },
+        {{ 0x20, 0xa0, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20 }, MAX7221_PATTERN_TICKS },
+        {{ 0x10, 0x90, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10 }, MAX7221_PATTERN_TICKS },
+        {{ 0x08, 0x88, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08 }, MAX7221_PATTERN_TICKS },
+        {{ 0x04, 0x84, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04 }, MAX7221_PATTERN_TICKS },
+        {{ 0x02, 0x82, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02 }, MAX7221_PATTERN_TICKS },
+        {{ 0x40, 0x40, 0xc0, 0x40, 0x40, 0x40, 0x40, 0x40 }, MAX7221_PATTERN_TICKS },
+        {{ 0x20, 0x20, 0xa0, 0x20, 0x20, 0x20, 0x20, 0x20 }, MAX7221_PATTERN_TICKS },
+        {{ 0x10, 0x10, 0x90, 0x10, 0x10, 0x10, 0x10, 0x10 }, MAX7221_PATTERN_TICKS },
+        {{ 0x08, 0x08, 0x88, 0x08, 0x08, 0x08, 0x08, 0x08 }, MAX7221_PATTERN_TICKS },
+        {{ 0x04, 0x04, 0x84, 0x04, 0x04, 0x04, 0x04, 0x04 }, MAX7221_PATTERN_TICKS },
+        {{ 0x02, 0x02, 0x82, 0x02, 0x02, 0x02, 0x02, 0x02 }, MAX7221_PATTERN_TICKS },
+        {{ 0x40, 0x40, 0x40, 0xc0, 0x40, 0x40, 0x40, 0x40 }, MAX7221_PATTERN_TICKS },
+        {{ 0x20, 0x20, 0x20, 0xa0, 0x20, 0x20, 0x20, 0x20 }, MAX7221_PATTERN_TICKS },
+        {{ 0x10, 0x10, 0x10, 0x90, 0x10, 0x10, 0x10, 0x10 }, MAX7221_PATTERN_TICKS },
+        {{ 0x08, 0x08, 0x08, 0x88, 0x08, 0x08, 0x08, 0x08 }, MAX7221_PATTERN_TICKS },
+        {{ 0x04, 0x04, 0x04, 0x84, 0x04, 0x04, 0x04, 0x04 }, MAX7221_PATTERN_TICKS },
+        {{ 0x02, 0x02, 0x02, 0x82, 0x02, 0x02, 0x02, 0x02 }, MAX7221_PATTERN_TICKS },
+        {{ 0x40, 0x40, 0x40, 0x40, 0xc0, 0x40, 0x40, 0x40 }, MAX7221_PATTERN_TICKS },
+        {{ 0x20, 0x20, 0x20, 0x20, 0xa0, 0x20, 0x20, 0x20 }, MAX7221_PATTERN_TICKS },
+        {{ 0x10, 0x10, 0x10, 0x10, 0x90, 0x10, 0x10, 0x10 }, MAX7221_PATTERN_TICKS },
+        {{ 0x08, 0x08, 0x08, 0x08, 0x88, 0x08, 0x08, 0x08 }, MAX7221_PATTERN_TICKS },
+        {{ 0x04, 0x04, 0x04, 0x04, 0x84, 0x04, 0x04, 0x04 }, MAX7221_PATTERN_TICKS },
+        {{ 0x02, 0x02, 0x02, 0x02, 0x82, 0x02, 0x02, 0x02 }, MAX7221_PATTERN_TICKS },
+        {{ 0x40, 0x40, 0x40, 0x40, 0x40, 0xc0, 0x40, 0x40 }, MAX7221_PATTERN_TICKS },
+        {{ 0x20, 0x20, 0x20, 0x20, 0x20, 0xa0, 0x20, 0x20 }, MAX7221_PATTERN_TICKS },
+        {{ 0x10, 0x10, 0x10, 0x10, 0x10, 0x90, 0x10, 0x10 }, MAX7221_PATTERN_TICKS },
+        {{ 0x08, 0x08, 0x08, 0x08, 0x08, 0x88, 0x08, 0x08 }, MAX7221_PATTERN_TICKS },
+        {{ 0x04, 0x04, 0x04, 0x04, 0x04, 0x84, 0x04, 0x04 }, MAX7221_PATTERN_TICKS },
+        {{ 0x02, 0x02, 0x02, 0x02, 0x02, 0x82, 0x02, 0x02 }, MAX7221_PATTERN_TICKS },
+        {{ 0x40, 0x40, 0x40, 0x40, 0x40, 0x40, 0xc0, 0x40 }, MAX7221_PATTERN_TICKS },
+        {{ 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0xa0, 0x20 }, MAX7221_PATTERN_TICKS },
+        {{ 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x90, 0x10 }, MAX7221_PATTERN_TICKS },
+        {{ 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x88, 0x08 }, MAX7221_PATTERN_TICKS },
+        {{ 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x84, 0x04 }, MAX7221_PATTERN_TICKS },
+        {{ 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x82, 0x02 }, MAX7221_PATTERN_TICKS },
+        {{ 0x40, 0x40, 0x40, 0x40, 0x40, 0x40, 0x40, 0xc0 }, MAX7221_PATTERN_TICKS },
+        {{ 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0xa0 }, MAX7221_PATTERN_TICKS },
+        {{ 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x90 }, MAX7221_PATTERN_TICKS },
+        {{ 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x88 }, MAX7221_PATTERN_TICKS },
+        {{ 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x84 }, MAX7221_PATTERN_TICKS },
+        {{ 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x82 }, MAX7221_PATTERN_TICKS },
+};
+
+// State of the running animation
+static struct {
+    const MAX7221Frame* frames;     // frame table (in program memory)
+    uint8_t count;                  // number of frames (0 if stopped)
+    uint8_t index;                  // index of the next frame to show
+    uint8_t remaining;              // ticks left for the current frame
+    bool repeat;                    // restart after the last frame
+    bool fresh;                     // no frame has been shown yet
+    uint8_t shown[8];               // patterns currently displayed
+} anim;
+
+// Ticks left before display test mode is turned off
+static uint8_t test_remaining;
+
+// Code B decode flags currently set in the decode mode register
+static uint8_t decode_mask;
+
+static void max7221_set_decode(uint8_t mask) {
+    if (mask != decode_mask) {
+        max7221_write(MAX7221_DECODE_MODE, mask);
+        decode_mask = mask;
+    }
+}
+
+/**
+ * Converts a binary value to packed BCD using the shift-add-3 (double
+ * dabble) algorithm, avoiding 32-bit division on the AVR.
+ * @param value the value to convert (at most MAX7221_UDEC_MAX)
+ * @return eight BCD digits; least significant digit in the low nibble
+ */
+static uint32_t max7221_to_bcd(uint32_t value) {
+    uint8_t bcd[4] = { 0, 0, 0, 0 };      // bcd[0] holds the low digits
+    uint8_t bits = 32;
+
+    // leading zero bits contribute nothing
+    while (bits != 0 && !(value & 0x80000000UL)) {
+        value <<= 1;
+        bits--;
+    }
+
+    while (bits-- != 0) {
+        for (uint8_t i = 0; i < 4; i++) {
+            uint8_t b = bcd[i];
+            if ((b & 0x0f) >= 0x05) {
+                b += 0x03;
+            }
+            if ((b & 0xf0) >= 0x50) {
+                b += 0x30;
+            }
+            bcd[i] = b;
+        }
+
+        uint8_t carry = (value & 0x80000000UL) ? 1 : 0;
+        value <<= 1;
+        for (uint8_t i = 0; i < 4; i++) {
+            uint8_t next = bcd[i] >> 7;
+            bcd[i] = (bcd[i] << 1) | carry;
+            carry = next;
+        }
+    }
+
+    return ((uint32_t) bcd[3] << 24) | ((uint32_t) bcd[2] << 16)
+            | ((uint16_t) bcd[1] << 8) | bcd[0];
+}
+
+/**
+ * Displays packed BCD digits using Code B decode on all eight digits.
+ * @param bcd eight BCD digits; least significant digit in the low nibble
+ * @param negative flag indicating whether a minus sign should be shown
+ * @param places number of digits to the right of the decimal point
+ * @param blank flag indicating whether leading zeros should be blanked
+ */
+static void max7221_display_bcd(uint32_t bcd, bool negative, uint8_t places,
+        bool blank) {
+    uint8_t digits = negative ? 7 : 8;
+
+    if (blank) {
+        // keep at least one digit to the left of the decimal point
+        while (digits > places + 1
+                && ((bcd >> ((digits - 1) << 2)) & 0xf) == 0) {
+            digits--;
+        }
+    }
+
+    max7221_set_decode(0xff);
+    for (uint8_t i = 0; i < 8; i++) {
+        uint8_t code = MAX7221_CODE_B_BLANK;
+        if (i < digits) {
+            code = bcd & 0xf;
+            bcd >>= 4;
+        }
+        else if (negative) {
+            code = MAX7221_CODE_B_DASH;
+            negative = false;
+        }
+        if (places != 0 && i == places) {
+            code |= MAX7221_POINT;
+        }
+        max7221_write(i + 1, code);
+    }
+}
+
+static void max7221_display_overflow(void) {
+    max7221_set_decode(0xff);
+    for (uint8_t i = 0; i < 8; i++) {
+        max7221_write(i + 1, MAX7221_CODE_B_DASH);
+    }
+}
+
 void max7221_write(uint8_t address, uint8_t data) {
+    TRACE_ENTER(TRACE_MAX7221_WRITE);
+
     // Assert chip select
-    MAX7221_PORT &= ~MAX7221_MASK;
+    MAX7221_SELECT();
 
     spi_transfer(address);
     spi_transfer(data);
 
     // Release chip select to load the data
-    MAX7221_PORT |= MAX7221_MASK;
+    MAX7221_DESELECT();
+
+    TRACE_EXIT(TRACE_MAX7221_WRITE);
+}
+
+void max7221_chain_write(uint8_t count, uint8_t address, uint8_t data) {
+    MAX7221_SELECT();
+
+    // Every device in the chain latches the same register/data pair
+    for (uint8_t i = 0; i < count; i++) {
+        spi_transfer(address);
+        spi_transfer(data);
+    }
+
+    MAX7221_DESELECT();
+}
+
+void max7221_chain_write_device(uint8_t count, uint8_t device,
+        uint8_t address, uint8_t data) {
+    MAX7221_SELECT();
+
+    // The first word shifted out ends up in the last device of the chain,
+    // so devices are visited from the far end back towards the AVR
+    for (uint8_t i = count; i-- > 0; ) {
+        if (i == device) {
+            spi_transfer(address);
+            spi_transfer(data);
+        }
+        else {
+            spi_transfer(MAX7221_NOOP);
+            spi_transfer(0);
+        }
+    }
+
+    MAX7221_DESELECT();
+}
+
+void max7221_chain_write_row(uint8_t count, uint8_t address,
+        const uint8_t data[]) {
+    MAX7221_SELECT();
+
+    for (uint8_t i = count; i-- > 0; ) {
+        spi_transfer(address);
+        spi_transfer(data[i]);
+    }
+
+    MAX7221_DESELECT();
 }
 
 void max7221_init() {
@@ -50,14 +340,19 @@ void max7221_init() {
     MAX7221_PORT |= MAX7221_MASK;
 }
 
+void max7221_display_test() {
+    max7221_write(MAX7221_DISPLAY_TEST, 0x01);
+    test_remaining = MAX7221_TEST_TICKS;
+}
+
 void max7221_config() {
-    // Test display
-    max7221_write(0x0F, 0x01);
-    _delay_ms(MAX7221_TEST_DELAY_MS);
-    max7221_write(0x0F, 0x00);
+    // Normal operation (not display test)
+    max7221_write(MAX7221_DISPLAY_TEST, 0x00);
+    test_remaining = 0;
 
     // Disable decode
-    max7221_write(0x9, 0);
+    max7221_write(MAX7221_DECODE_MODE, 0);
+    decode_mask = 0;
 
     // Max intensity
     max7221_write(0x0A, 0x0f);
@@ -70,6 +365,7 @@ void max7221_config() {
 }
 
 void max7221_display_hex4(uint8_t x, uint8_t value, bool point) {
+    max7221_set_decode(decode_mask & ~(1 << (7 - x)));
     uint8_t pattern = pgm_read_byte(&(PATTERNS[value & 0xf]));
     if (point) {
         pattern |= 0x80;
@@ -78,11 +374,13 @@ void max7221_display_hex4(uint8_t x, uint8_t value, bool point) {
 }
 
 void max7221_display_uint8(uint8_t x, uint8_t value) {
+    max7221_set_decode(decode_mask & ~(0x3 << (6 - x)));
     max7221_write(8 - x, pgm_read_byte(&(PATTERNS[value >> 4])));
     max7221_write(8 - x - 1, pgm_read_byte(&(PATTERNS[value & 0xf])));
 }
 
 void max7221_display_uint32(uint32_t value) {
+    max7221_set_decode(0);
     for (uint8_t i = 0; i < 8; i++) {
         uint8_t pattern = pgm_read_byte(&(PATTERNS[value & 0xf]));
         max7221_write(i + 1, pattern);
@@ -90,76 +388,132 @@ void max7221_display_uint32(uint32_t value) {
     }
 }
 
+void max7221_display_udec(uint32_t value, bool blank) {
+    if (value > MAX7221_UDEC_MAX) {
+        max7221_display_overflow();
+        return;
+    }
+    max7221_display_bcd(max7221_to_bcd(value), false, 0, blank);
+}
+
+void max7221_display_sdec(int32_t value, bool blank) {
+    max7221_display_fixed(value, 0, blank);
+}
+
+void max7221_display_fixed(int32_t value, uint8_t places, bool blank) {
+    bool negative = value < 0;
+    uint32_t magnitude = negative ? -(uint32_t) value : (uint32_t) value;
+
+    // a negative value needs a digit for the sign and one for the units
+    if (places > (negative ? 6 : 7)
+            || magnitude > (negative ? MAX7221_SDEC_MAX : MAX7221_UDEC_MAX)) {
+        max7221_display_overflow();
+        return;
+    }
+    max7221_display_bcd(max7221_to_bcd(magnitude), negative, places, blank);
+}
+
+void max7221_chain_display_uint32(uint8_t count, const uint32_t values[]) {
+    for (uint8_t digit = 0; digit < 8; digit++) {
+        uint8_t shift = digit << 2;
+
+        MAX7221_SELECT();
+        for (uint8_t i = count; i-- > 0; ) {
+            spi_transfer(digit + 1);
+            spi_transfer(pgm_read_byte(&(PATTERNS[(values[i] >> shift) & 0xf])));
+        }
+        MAX7221_DESELECT();
+    }
+}
+
 void max7221_blank_digit(uint8_t x) {
-    max7221_write(8 - x, 0);
+    bool decoded = decode_mask & (1 << (7 - x));
+    max7221_write(8 - x, decoded ? MAX7221_CODE_B_BLANK : 0);
 }
 
 void max7221_blank_display() {
     for (int i = 0; i < 8; i++) {
-        max7221_write(i + 1, 0);
+        bool decoded = decode_mask & (1 << i);
+        max7221_write(i + 1, decoded ? MAX7221_CODE_B_BLANK : 0);
     }
 }
 
-void max7221_snake_pattern() {
-    for (int i = 0; i < 8; i++) {
-        max7221_write(8 - i, 0b01000000);
-        _delay_ms(MAX7221_PATTERN_DELAY_MS);
-    }
-    max7221_write(1, 0b01100000);
-    _delay_ms(MAX7221_PATTERN_DELAY_MS);
-    max7221_write(1, 0b01100001);
-    _delay_ms(MAX7221_PATTERN_DELAY_MS);
-    for (int i = 1; i < 8; i++) {
-        max7221_write(i + 1, 0b01000001);
-        _delay_ms(MAX7221_PATTERN_DELAY_MS);
-    }
-    max7221_write(8, 0b01000101);
-    _delay_ms(MAX7221_PATTERN_DELAY_MS);
-    max7221_write(8, 0b01001101);
-    _delay_ms(MAX7221_PATTERN_DELAY_MS);
-    for (int i = 1; i < 7; i++) {
-        max7221_write(8 - i, 0b01001001);
-        _delay_ms(MAX7221_PATTERN_DELAY_MS);
-    }
-    max7221_write(1, 0b01101001);
-
-    max7221_write(8, 0b00001101);
-    for (int i = 1; i < 7; i++) {
-        max7221_write(8 - i, 0b00001001);
-        _delay_ms(MAX7221_PATTERN_DELAY_MS);
-    }
-    max7221_write(1, 0b00101001);
-    _delay_ms(MAX7221_PATTERN_DELAY_MS);
-    max7221_write(1, 0b00001001);
-    _delay_ms(MAX7221_PATTERN_DELAY_MS);
-    for (int i = 0; i < 7; i++) {
-        max7221_write(i + 1, 0b00001000);
-        _delay_ms(MAX7221_PATTERN_DELAY_MS);
-    }
-    max7221_write(8, 0b00001100);
-    _delay_ms(MAX7221_PATTERN_DELAY_MS);
-    max7221_write(8, 0b00001000);
-    _delay_ms(MAX7221_PATTERN_DELAY_MS);
-    for (int i = 0; i < 8; i++) {
-        max7221_write(8 - i, 0b00000000);
-        _delay_ms(MAX7221_PATTERN_DELAY_MS);
-    }
+void max7221_anim_start(const MAX7221Frame* frames, uint8_t count,
+        bool repeat) {
+    anim.frames = frames;
+    anim.count = count;
+    anim.index = 0;
+    anim.remaining = 0;
+    anim.repeat = repeat;
+    anim.fresh = true;
 }
 
-void max7221_spin_pattern() {
-    for (int turn = 0; turn < 8; turn++) {
-        uint8_t i = 0x40;
-        while (i != 1) {
-            for (int j = 0; j < 8; j++) {
-                uint8_t pattern = i;
-                if (j == 7 - turn) {
-                    pattern |= 0x80;
-                }
-                max7221_write(j + 1, pattern);
-            }
-            _delay_ms(MAX7221_PATTERN_DELAY_MS);
-            i >>= 1;
+void max7221_anim_stop() {
+    anim.count = 0;
+}
+
+bool max7221_anim_running() {
+    return anim.count != 0;
+}
+
+bool max7221_anim_tick() {
+    if (test_remaining != 0 && --test_remaining == 0) {
+        max7221_write(MAX7221_DISPLAY_TEST, 0);
+    }
+
+    if (anim.count == 0) {
+        return test_remaining != 0;
+    }
+
+    if (anim.remaining != 0 && --anim.remaining != 0) {
+        return true;
+    }
+
+    if (anim.index == anim.count) {
+        if (!anim.repeat) {
+            anim.count = 0;
+            return test_remaining != 0;
+        }
+        anim.index = 0;
+    }
+
+    const MAX7221Frame* frame = &anim.frames[anim.index++];
+    max7221_set_decode(0);
+    for (uint8_t x = 0; x < 8; x++) {
+        uint8_t pattern = pgm_read_byte(&(frame->digits[x]));
+        // only digits that differ from the previous frame are sent
+        if (anim.fresh || pattern != anim.shown[x]) {
+            max7221_write(8 - x, pattern);
+            anim.shown[x] = pattern;
         }
     }
+    anim.fresh = false;
+    anim.remaining = pgm_read_byte(&(frame->ticks));
+    return true;
+}
+
+void max7221_anim_snake() {
+    max7221_anim_start(SNAKE_FRAMES,
+            sizeof(SNAKE_FRAMES) / sizeof(SNAKE_FRAMES[0]), false);
+}
+
+void max7221_anim_spin() {
+    max7221_anim_start(SPIN_FRAMES,
+            sizeof(SPIN_FRAMES) / sizeof(SPIN_FRAMES[0]), false);
+}
+
+static void max7221_anim_run() {
+    while (max7221_anim_tick()) {
+        _delay_ms(MAX7221_ANIM_TICK_MS);
+    }
 }
 
+void max7221_snake_pattern() {
+    max7221_anim_snake();
+    max7221_anim_run();
+}
+
+void max7221_spin_pattern() {
+    max7221_anim_spin();
+    max7221_anim_run();
+}
@@ -4,8 +4,26 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+/*
+ * Period (in milliseconds) at which max7221_anim_tick is expected to be
+ * called, from 4 to 75. Frame durations and the display test period are
+ * measured in ticks of this length.
+ */
+#ifndef MAX7221_ANIM_TICK_MS
+#define MAX7221_ANIM_TICK_MS    25
+#endif
+
+/*
+ * An animation frame. Frame tables are stored in program memory.
+ */
+typedef struct {
+    uint8_t digits[8];      /* segment patterns, leftmost digit first */
+    uint8_t ticks;          /* number of ticks to show the frame */
+} MAX7221Frame;
+
 void max7221_init();
 void max7221_config();
+void max7221_display_test();
 void max7221_blank_display();
 void max7221_snake_pattern();
 void max7221_spin_pattern();
@@ -16,4 +34,39 @@ void max7221_display_uint8(uint8_t x, uint8_t value);
 void max7221_display_uint32(uint32_t value);
 void max7221_write(uint8_t address, uint8_t data);
 
+/*
+ * Cascaded (daisy-chained) devices. Each function takes the number of
+ * devices in the chain and shifts 2 bytes per device during a single
+ * chip select assertion. Device 0 is the device whose DIN is connected
+ * to the AVR; device (count - 1) is the last device in the chain.
+ */
+void max7221_chain_write(uint8_t count, uint8_t address, uint8_t data);
+void max7221_chain_write_device(uint8_t count, uint8_t device,
+        uint8_t address, uint8_t data);
+void max7221_chain_write_row(uint8_t count, uint8_t address,
+        const uint8_t data[]);
+void max7221_chain_display_uint32(uint8_t count, const uint32_t values[]);
+
+/*
+ * Decimal display using the Code B decode mode of the MAX 7221. Values
+ * that do not fit in eight digits are shown as dashes. When blank is set,
+ * leading zeros are not shown.
+ */
+void max7221_display_udec(uint32_t value, bool blank);
+void max7221_display_sdec(int32_t value, bool blank);
+void max7221_display_fixed(int32_t value, uint8_t places, bool blank);
+
+/*
+ * Non-blocking animation. After an animation is started, each call to
+ * max7221_anim_tick advances it; the tick function returns false once
+ * the animation (and any display test) has finished.
+ */
+void max7221_anim_start(const MAX7221Frame* frames, uint8_t count,
+        bool repeat);
+void max7221_anim_stop();
+bool max7221_anim_running();
+bool max7221_anim_tick();
+void max7221_anim_snake();
+void max7221_anim_spin();
+
 #endif //MAX7221_H
@@ -0,0 +1,207 @@
+/***************************************************************
+ * Lock-free single-producer, single-consumer ring buffers of
+ * bytes, for passing data between an interrupt handler and the
+ * main program.
+ *
+ * Each ring is instantiated by the RING_DEFINE macro, which
+ * defines its storage and a set of inline functions named after
+ * it. One side of the program (e.g. an interrupt handler) may
+ * only push bytes and the other may only pop them; neither side
+ * needs to disable interrupts, because each 8-bit index is written
+ * by only one side and is read and written in a single access.
+ *
+ * @author Carl Harris
+ ***************************************************************/
+
+#ifndef RING_H
+#define RING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Compiler barrier that keeps accesses to the data of a ring on the
+ * correct side of the accesses to the index written by the other side.
+ */
+#define RING_BARRIER()  __asm__ __volatile__ ("" ::: "memory")
+
+#ifdef __AVR__
+
+/*
+ * Single-byte push and pop in assembly, so that their cost in an
+ * interrupt handler does not depend on the compiler or its options.
+ * Once Z points at the ring (2 cycles), a push takes 20 cycles (9 if
+ * the ring is full) and a pop 19 (8 if it is empty), including the
+ * result. Each side still writes its index last, in a single st/std.
+ */
+#define RING_DEFINE_PUSH_POP(name, size) \
+  static inline bool name##_push(uint8_t b) { \
+    void* p = &name; \
+    uint8_t head, tmp; \
+    bool ok; \
+    __asm__ __volatile__ ( \
+        "clr %[ok]"               "\n\t" \
+        "ld %[head], Z"           "\n\t"  /* head */ \
+        "ldd %[tmp], Z+1"         "\n\t"  /* tail */ \
+        "sub %[tmp], %[head]"     "\n\t" \
+        "cpi %[tmp], %[full]"     "\n\t"  /* full if head - tail == size */ \
+        "breq 1f"                 "\n\t" \
+        "mov %[tmp], %[head]"     "\n\t" \
+        "andi %[tmp], %[mask]"    "\n\t" \
+        "add %A[p], %[tmp]"       "\n\t" \
+        "adc %B[p], __zero_reg__" "\n\t" \
+        "std Z+2, %[b]"           "\n\t"  /* data[head & mask] */ \
+        "sub %A[p], %[tmp]"       "\n\t" \
+        "sbc %B[p], __zero_reg__" "\n\t" \
+        "inc %[head]"             "\n\t" \
+        "st Z, %[head]"           "\n\t" \
+        "inc %[ok]"               "\n" \
+        "1:" \
+        : [ok] "=&r" (ok), [head] "=&r" (head), [tmp] "=&d" (tmp), \
+          [p] "+z" (p) \
+        : [b] "r" (b), [full] "M" ((uint8_t) (256 - (size))), \
+          [mask] "M" ((size) - 1) \
+        : "memory"); \
+    return ok; \
+  } \
+  \
+  static inline bool name##_pop(uint8_t* b) { \
+    void* p = &name; \
+    uint8_t tail, tmp, byte; \
+    bool ok; \
+    __asm__ __volatile__ ( \
+        "clr %[ok]"               "\n\t" \
+        "ldd %[tail], Z+1"        "\n\t"  /* tail */ \
+        "ld %[tmp], Z"            "\n\t"  /* head */ \
+        "cp %[tmp], %[tail]"      "\n\t" \
+        "breq 1f"                 "\n\t" \
+        "mov %[tmp], %[tail]"     "\n\t" \
+        "andi %[tmp], %[mask]"    "\n\t" \
+        "add %A[p], %[tmp]"       "\n\t" \
+        "adc %B[p], __zero_reg__" "\n\t" \
+        "ldd %[byte], Z+2"        "\n\t"  /* data[tail & mask] */ \
+        "sub %A[p], %[tmp]"       "\n\t" \
+        "sbc %B[p], __zero_reg__" "\n\t" \
+        "inc %[tail]"             "\n\t" \
+        "std Z+1, %[tail]"        "\n\t" \
+        "inc %[ok]"               "\n" \
+        "1:" \
+        : [ok] "=&r" (ok), [tail] "=&r" (tail), [tmp] "=&d" (tmp), \
+          [byte] "=&r" (byte), [p] "+z" (p) \
+        : [mask] "M" ((size) - 1) \
+        : "memory"); \
+    if (ok) { \
+      *b = byte; \
+    } \
+    return ok; \
+  }
+
+#else
+
+#define RING_DEFINE_PUSH_POP(name, size) \
+  static inline bool name##_push(uint8_t b) { \
+    uint8_t head = name.head; \
+    if ((uint8_t) (head - name.tail) == (size)) { \
+      return false; \
+    } \
+    name.data[head & ((size) - 1)] = b; \
+    RING_BARRIER(); \
+    name.head = head + 1; \
+    return true; \
+  } \
+  \
+  static inline bool name##_pop(uint8_t* b) { \
+    uint8_t tail = name.tail; \
+    if (name.head == tail) { \
+      return false; \
+    } \
+    RING_BARRIER(); \
+    *b = name.data[tail & ((size) - 1)]; \
+    RING_BARRIER(); \
+    name.tail = tail + 1; \
+    return true; \
+  }
+
+#endif /* __AVR__ */
+
+/*
+ * Defines a ring buffer with the given name and size, which must be a
+ * power of two from 2 to 128. The ring and its functions are static,
+ * so a ring is shared only by the code in one source file.
+ *
+ * The indices run freely from 0 to 255, so the number of bytes in the
+ * ring is their difference, and every slot can be used.
+ *
+ * Producer functions:
+ *   bool name_push(uint8_t b)
+ *       pushes a byte; returns false if the ring is full
+ *   uint8_t name_push_bulk(const uint8_t* data, uint8_t n)
+ *       pushes up to n bytes; returns the number pushed
+ *   uint8_t name_space(void)
+ *       returns the number of bytes that can be pushed
+ *
+ * Consumer functions:
+ *   bool name_pop(uint8_t* b)
+ *       pops a byte; returns false if the ring is empty
+ *   uint8_t name_pop_bulk(uint8_t* data, uint8_t n)
+ *       pops up to n bytes; returns the number popped
+ *   uint8_t name_count(void)
+ *       returns the number of bytes that can be popped
+ *   void name_clear(void)
+ *       discards the bytes in the ring
+ */
+#define RING_DEFINE(name, size) \
+  typedef char name##_size_check[ \
+      ((size) >= 2 && (size) <= 128 && ((size) & ((size) - 1)) == 0) \
+      ? 1 : -1]; \
+  \
+  static struct { \
+    volatile uint8_t head;      /* index of the next byte to push */ \
+    volatile uint8_t tail;      /* index of the next byte to pop */ \
+    uint8_t data[size]; \
+  } name; \
+  \
+  static inline uint8_t name##_count(void) { \
+    return (uint8_t) (name.head - name.tail); \
+  } \
+  \
+  static inline uint8_t name##_space(void) { \
+    return (size) - (uint8_t) (name.head - name.tail); \
+  } \
+  \
+  RING_DEFINE_PUSH_POP(name, size) \
+  \
+  static inline uint8_t name##_push_bulk(const uint8_t* data, uint8_t n) { \
+    uint8_t head = name.head; \
+    uint8_t space = (size) - (uint8_t) (head - name.tail); \
+    if (n > space) { \
+      n = space; \
+    } \
+    for (uint8_t i = 0; i < n; i++) { \
+      name.data[(uint8_t) (head + i) & ((size) - 1)] = data[i]; \
+    } \
+    RING_BARRIER(); \
+    name.head = head + n; \
+    return n; \
+  } \
+  \
+  static inline uint8_t name##_pop_bulk(uint8_t* data, uint8_t n) { \
+    uint8_t tail = name.tail; \
+    uint8_t count = (uint8_t) (name.head - tail); \
+    if (n > count) { \
+      n = count; \
+    } \
+    RING_BARRIER(); \
+    for (uint8_t i = 0; i < n; i++) { \
+      data[i] = name.data[(uint8_t) (tail + i) & ((size) - 1)]; \
+    } \
+    RING_BARRIER(); \
+    name.tail = tail + n; \
+    return n; \
+  } \
+  \
+  static inline void name##_clear(void) { \
+    name.tail = name.head; \
+  }
+
+#endif /* RING_H */
@@ -0,0 +1,218 @@
+/***************************************************************
+ * A monotonic timebase and a cooperative, run-to-completion task
+ * loop for AVR microcontrollers.
+ *
+ * @author Carl Harris
+ ***************************************************************/
+
+#include <stddef.h>
+#include <avr/interrupt.h>
+#include <avr/io.h>
+#include <avr/sleep.h>
+
+#include "sched.h"
+
+/*
+ * Prescaler for the timer clock. The timer counts to SCHED_TIMER_TOP
+ * once per millisecond, so F_CPU / SCHED_TIMER_PRESCALE / 1000 must be
+ * at most 256.
+ */
+#ifndef SCHED_TIMER_PRESCALE
+#if F_CPU > 16384000UL
+#define SCHED_TIMER_PRESCALE  128
+#elif F_CPU >= 2048000UL
+#define SCHED_TIMER_PRESCALE  64
+#else
+#define SCHED_TIMER_PRESCALE  8
+#endif
+#endif
+
+#define SCHED_TIMER_TOP   (F_CPU / SCHED_TIMER_PRESCALE / 1000 - 1)
+
+#if SCHED_TIMER_TOP > 255 || SCHED_TIMER_TOP < 7
+#error "SCHED_TIMER_PRESCALE does not suit F_CPU"
+#endif
+
+// microseconds per timer count, in 1/256ths
+#define SCHED_COUNT_SCALE (256000UL / (SCHED_TIMER_TOP + 1))
+
+#if defined(TCCR2A)
+// Timer/Counter2 of the ATmega series, in CTC mode
+#if SCHED_TIMER_PRESCALE == 8
+#define SCHED_TIMER_CS    (1 << CS21)
+#elif SCHED_TIMER_PRESCALE == 32
+#define SCHED_TIMER_CS    ((1 << CS21) | (1 << CS20))
+#elif SCHED_TIMER_PRESCALE == 64
+#define SCHED_TIMER_CS    (1 << CS22)
+#elif SCHED_TIMER_PRESCALE == 128
+#define SCHED_TIMER_CS    ((1 << CS22) | (1 << CS20))
+#else
+#error "SCHED_TIMER_PRESCALE must be 8, 32, 64 or 128"
+#endif
+#define SCHED_TCNT        TCNT2
+#define SCHED_TIFR        TIFR2
+#define SCHED_OCF         OCF2A
+#define SCHED_TIMER_vect  TIMER2_COMPA_vect
+#elif defined(TCCR1) && defined(OCR1C)
+// Timer/Counter1 of the ATtiny25/45/85, in CTC mode
+#if SCHED_TIMER_PRESCALE == 8
+#define SCHED_TIMER_CS    (1 << CS12)
+#elif SCHED_TIMER_PRESCALE == 32
+#define SCHED_TIMER_CS    ((1 << CS12) | (1 << CS11))
+#elif SCHED_TIMER_PRESCALE == 64
+#define SCHED_TIMER_CS    ((1 << CS12) | (1 << CS11) | (1 << CS10))
+#elif SCHED_TIMER_PRESCALE == 128
+#define SCHED_TIMER_CS    (1 << CS13)
+#else
+#error "SCHED_TIMER_PRESCALE must be 8, 32, 64 or 128"
+#endif
+#define SCHED_TCNT        TCNT1
+#define SCHED_TIFR        TIFR
+#define SCHED_OCF         OCF1A
+#define SCHED_TIMER_vect  TIM1_COMPA_vect
+#else
+#error "no timer for the timebase on this microcontroller"
+#endif
+
+static volatile uint32_t millis;
+
+static SchedTask* tasks;
+static volatile bool posted_any;      // a task was posted since the last pass
+static bool timed;                    // a task is waiting for a time
+static uint32_t soonest;              // earliest time a task is due
+
+ISR(SCHED_TIMER_vect) {
+  millis++;
+}
+
+void sched_init(void) {
+#if defined(TCCR2A)
+  TCCR2A = (1 << WGM21);
+  TCCR2B = SCHED_TIMER_CS;
+  OCR2A = SCHED_TIMER_TOP;
+  TCNT2 = 0;
+  TIMSK2 |= (1 << OCIE2A);
+#else
+  TCCR1 = (1 << CTC1) | SCHED_TIMER_CS;
+  OCR1C = SCHED_TIMER_TOP;
+  OCR1A = SCHED_TIMER_TOP;
+  TCNT1 = 0;
+  TIMSK |= (1 << OCIE1A);
+#endif
+}
+
+uint32_t sched_micros(void) {
+  uint8_t sreg = SREG;
+  cli();
+  uint32_t ms = millis;
+  uint8_t count = SCHED_TCNT;
+  // the counter has wrapped but the interrupt has not yet been taken
+  if ((SCHED_TIFR & (1 << SCHED_OCF)) && count < SCHED_TIMER_TOP / 2) {
+    ms++;
+  }
+  SREG = sreg;
+  return ms * 1000 + (uint16_t) ((count * SCHED_COUNT_SCALE) >> 8);
+}
+
+uint32_t sched_millis(void) {
+  uint8_t sreg = SREG;
+  cli();
+  uint32_t ms = millis;
+  SREG = sreg;
+  return ms;
+}
+
+void sched_delay_us(uint32_t us) {
+  uint32_t deadline = sched_deadline(us);
+  while (!sched_reached(deadline)) {
+    ;
+  }
+}
+
+void sched_start(SchedTask* task, SchedStep step, void* ctx) {
+  task->step = step;
+  task->ctx = ctx;
+  task->wake = sched_micros();
+  task->posted = false;
+  task->waiting = false;
+
+  SchedTask** p = &tasks;
+  while (*p != NULL && *p != task) {
+    p = &(*p)->next;
+  }
+  if (*p == NULL) {
+    task->next = NULL;
+    *p = task;
+  }
+}
+
+void sched_stop(SchedTask* task) {
+  for (SchedTask** p = &tasks; *p != NULL; p = &(*p)->next) {
+    if (*p == task) {
+      *p = task->next;
+      return;
+    }
+  }
+}
+
+void sched_post(SchedTask* task) {
+  task->posted = true;
+  posted_any = true;
+}
+
+bool sched_run_once(void) {
+  bool ran = false;
+  uint32_t now = sched_micros();
+
+  posted_any = false;
+  timed = false;
+  SchedTask* task = tasks;
+  while (task != NULL) {
+    SchedTask* next = task->next;     // the step may stop its task
+    if (task->posted
+        || (!task->waiting && (int32_t) (now - task->wake) >= 0)) {
+      task->posted = false;
+      uint32_t delay = task->step(task);
+      ran = true;
+      if (delay == SCHED_DONE) {
+        sched_stop(task);
+        task = next;
+        continue;
+      }
+      if (delay == SCHED_WAIT) {
+        task->waiting = true;
+      }
+      else {
+        // the delay runs from the end of the step
+        task->waiting = false;
+        task->wake = sched_micros() + delay;
+      }
+    }
+    if (!task->waiting
+        && (!timed || (int32_t) (task->wake - soonest) < 0)) {
+      timed = true;
+      soonest = task->wake;
+    }
+    task = next;
+  }
+  return ran;
+}
+
+void sched_run(void) {
+  set_sleep_mode(SLEEP_MODE_IDLE);
+  for (;;) {
+    if (sched_run_once()) {
+      continue;
+    }
+    // idle until the next timer tick unless a step is due sooner
+    cli();
+    if (!posted_any
+        && (!timed || (int32_t) (soonest - sched_micros()) >= 1000)) {
+      sleep_enable();
+      sei();
+      sleep_cpu();
+      sleep_disable();
+    }
+    sei();
+  }
+}
@@ -0,0 +1,125 @@
+/***************************************************************
+ * A monotonic timebase and a cooperative, run-to-completion task
+ * loop for AVR microcontrollers.
+ *
+ * The timebase is driven by a compare match interrupt once per
+ * millisecond, from Timer/Counter2 on the ATmega series or
+ * Timer/Counter1 on the ATtiny85; the timer is reserved for this
+ * module. Times are given in microseconds, with the resolution of
+ * one count of the timer (4 us at 16 MHz).
+ *
+ * A task is a step function that does a bounded amount of work and
+ * returns the time to wait before its next step, rather than
+ * spinning in a delay loop.
+ *
+ * @author Carl Harris
+ ***************************************************************/
+
+#ifndef SCHED_H
+#define SCHED_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Values returned by a step function, in place of a delay, to wait
+ * until the task is posted, or to end the task.
+ */
+#define SCHED_WAIT    0xFFFFFFFEUL
+#define SCHED_DONE    0xFFFFFFFFUL
+
+typedef struct SchedTask SchedTask;
+
+/**
+ * A step of a task.
+ * @param task the task
+ * @return time to wait (in microseconds) before the next step, or
+ *      SCHED_WAIT or SCHED_DONE
+ */
+typedef uint32_t (*SchedStep)(SchedTask* task);
+
+/**
+ * A task. The fields are private to the scheduler except for ctx.
+ */
+struct SchedTask {
+    SchedStep step;
+    void* ctx;                  /* for use by the step function */
+    uint32_t wake;              /* time at which the next step is due */
+    volatile bool posted;       /* set by sched_post */
+    bool waiting;               /* waiting to be posted */
+    SchedTask* next;
+};
+
+/**
+ * Starts the timebase. Requires global interrupts to be enabled.
+ */
+void sched_init(void);
+
+/**
+ * Gets the time since sched_init. Wraps after about 71 minutes.
+ * @return time in microseconds
+ */
+uint32_t sched_micros(void);
+
+/**
+ * Gets the time since sched_init. Wraps after about 49 days.
+ * @return time in milliseconds
+ */
+uint32_t sched_millis(void);
+
+/**
+ * Gets a deadline for use with sched_reached.
+ * @param us time from now in microseconds (less than 35 minutes)
+ * @return the deadline
+ */
+static inline uint32_t sched_deadline(uint32_t us) {
+  return sched_micros() + us;
+}
+
+/**
+ * Tests whether a deadline has been reached. Correct across the wrap
+ * of sched_micros for deadlines less than 35 minutes away.
+ * @param deadline the deadline, from sched_deadline
+ */
+static inline bool sched_reached(uint32_t deadline) {
+  return (int32_t) (sched_micros() - deadline) >= 0;
+}
+
+/**
+ * Waits for a time, in blocking code that runs outside of a task.
+ * @param us time to wait in microseconds
+ */
+void sched_delay_us(uint32_t us);
+
+/**
+ * Adds a task to the loop. Its first step is run on the next pass.
+ * @param task the task
+ * @param step step function for the task
+ * @param ctx context for the step function
+ */
+void sched_start(SchedTask* task, SchedStep step, void* ctx);
+
+/**
+ * Removes a task from the loop, if it has not already ended.
+ */
+void sched_stop(SchedTask* task);
+
+/**
+ * Makes a task's next step due immediately, ending a wait for
+ * SCHED_WAIT or a delay. May be called from an interrupt handler, such
+ * as the completion callback of an interrupt-driven transfer.
+ */
+void sched_post(SchedTask* task);
+
+/**
+ * Runs each task whose step is due once.
+ * @return true if any step was run
+ */
+bool sched_run_once(void);
+
+/**
+ * Runs the task loop forever. The CPU idles between steps.
+ */
+void sched_run(void);
+
+#endif /* SCHED_H */
@@ -3,6 +3,13 @@
 
 #include "spi.h"
 
+#ifdef SPI_TRACE
+#include "trace.h"
+#else
+#define TRACE_ENTER(event)
+#define TRACE_EXIT(event)
+#endif
+
 #define DDR_SPI  DDRB
 #define MOSI _BV(PB3)
 #define MISO _BV(PB4)
@@ -22,11 +29,13 @@ void spi_disable(void) {
 }
 
 uint8_t spi_transfer(uint8_t data) {
+  TRACE_ENTER(TRACE_SPI_TRANSFER);
   SPDR = data;
   while (!(SPSR & _BV(SPIF))) {
     ; /* wait for the byte to be transmitted */
   }
   data = SPDR;
+  TRACE_EXIT(TRACE_SPI_TRANSFER);
   return data;
 }
 
@@ -0,0 +1,134 @@
+/***************************************************************
+ * Compile-time instrumentation hooks for timing interrupt
+ * handlers and the hot paths of the library modules.
+ *
+ * @author Carl Harris
+ ***************************************************************/
+
+#include <avr/interrupt.h>
+#include <avr/io.h>
+
+#include "trace.h"
+
+/*
+ * Clock select bits for Timer/Counter1, which runs free to timestamp
+ * the records in the trace ring. The default of F_CPU/8 wraps every
+ * 32.8 ms at 16 MHz on the ATmega series, and every 256 us at 8 MHz
+ * with the 8-bit Timer/Counter1 of the ATtiny85. Define as 0 to leave
+ * Timer/Counter1 as configured by the application.
+ */
+#ifndef TRACE_TIMER_CLOCK
+#if defined(TCCR1B)
+#define TRACE_TIMER_CLOCK   (1 << CS11)
+#else
+#define TRACE_TIMER_CLOCK   (1 << CS12)
+#endif
+#endif
+
+#ifdef TRACE_RING_SIZE
+static TraceRecord ring[TRACE_RING_SIZE];
+static uint8_t ring_next;       // index of the next record to write
+static uint8_t ring_count;      // number of records in the ring
+#endif
+
+void trace_init(void) {
+#ifdef TRACE_GPIO_PORT
+  TRACE_GPIO_PORT &= ~(1 << TRACE_GPIO_PIN);
+  TRACE_GPIO_DDR |= (1 << TRACE_GPIO_PIN);
+#endif
+#if defined(TRACE_RING_SIZE) && TRACE_TIMER_CLOCK != 0
+#if defined(TCCR1B)
+  TCCR1A = 0;
+  TCCR1B = TRACE_TIMER_CLOCK;
+#else
+  TCCR1 = TRACE_TIMER_CLOCK;
+#endif
+#endif
+}
+
+void trace_event(uint8_t event) {
+  if (event & TRACE_EXIT_FLAG) {
+    trace_exit(event & ~TRACE_EXIT_FLAG);
+  }
+  else {
+    trace_enter(event);
+  }
+}
+
+void trace_log(uint8_t event) {
+#ifdef TRACE_RING_SIZE
+  uint8_t sreg = SREG;
+  cli();
+  TraceRecord* record = &ring[ring_next];
+  record->time = TCNT1;
+  record->event = event;
+  ring_next = (ring_next + 1) & (TRACE_RING_SIZE - 1);
+  if (ring_count < TRACE_RING_SIZE) {
+    ring_count++;
+  }
+  SREG = sreg;
+#else
+  (void) event;
+#endif
+}
+
+int trace_read(TraceRecord* record) {
+#ifdef TRACE_RING_SIZE
+  int found = 0;
+  uint8_t sreg = SREG;
+  cli();
+  if (ring_count != 0) {
+    *record = ring[(ring_next - ring_count) & (TRACE_RING_SIZE - 1)];
+    ring_count--;
+    found = 1;
+  }
+  SREG = sreg;
+  return found;
+#else
+  (void) record;
+  return 0;
+#endif
+}
+
+#ifdef TRACE_RING_SIZE
+/**
+ * Formats a record as a line of text.
+ * @param buf receives the line; must have room for 11 characters
+ */
+static void format_record(const TraceRecord* record, char* buf) {
+  char digits[5];
+  uint16_t time = record->time;
+  uint8_t n = 0;
+  do {
+    digits[n++] = '0' + time % 10;
+    time /= 10;
+  } while (time != 0);
+  while (n != 0) {
+    *buf++ = digits[--n];
+  }
+  *buf++ = ' ';
+  *buf++ = (record->event & TRACE_EXIT_FLAG) ? '-' : '+';
+  uint8_t event = record->event & ~TRACE_EXIT_FLAG;
+  if (event >= 10) {
+    *buf++ = '0' + event / 10;
+  }
+  *buf++ = '0' + event % 10;
+  *buf++ = '\n';
+  *buf = 0;
+}
+#endif /* TRACE_RING_SIZE */
+
+void trace_dump(void (*puts)(const char* s)) {
+#ifdef TRACE_RING_SIZE
+  TraceRecord record;
+  char line[11];
+  // records added while dumping wait for the next dump
+  uint8_t count = ring_count;
+  while (count-- != 0 && trace_read(&record)) {
+    format_record(&record, line);
+    puts(line);
+  }
+#else
+  (void) puts;
+#endif
+}
@@ -0,0 +1,132 @@
+/***************************************************************
+ * Compile-time instrumentation hooks for timing interrupt
+ * handlers and the hot paths of the library modules.
+ *
+ * A module is instrumented only when its trace flag (such as
+ * SPI_TRACE) is defined when it is compiled; otherwise its hooks
+ * expand to nothing and this header is not needed. The hooks of
+ * an instrumented module drive a GPIO pin for a logic analyser
+ * (TRACE_GPIO_PORT), log Timer/Counter1 timestamps to a ring in
+ * RAM (TRACE_RING_SIZE), or both.
+ *
+ * This header may also be included by assembly sources, which
+ * see only the event identifiers.
+ *
+ * @author Carl Harris
+ ***************************************************************/
+
+#ifndef TRACE_H
+#define TRACE_H
+
+/*
+ * Traced events. An event is recorded when it is entered and again,
+ * with TRACE_EXIT_FLAG, when it is exited.
+ */
+#define TRACE_SERIAL_RX         0   /* USART receive interrupt handler */
+#define TRACE_SPI_TRANSFER      1   /* spi_transfer */
+#define TRACE_TWI_TRANSACTION   2   /* TWI transfer, from start to stop */
+#define TRACE_TWI_BYTE          3   /* TWI byte and its acknowledge */
+#define TRACE_LCD_NIBBLE        4   /* nibble written to the LCD */
+#define TRACE_MAX7221_WRITE     5   /* max7221_write */
+
+#define TRACE_EXIT_FLAG         0x80
+
+#ifndef __ASSEMBLER__
+
+#include <stdint.h>
+#include <avr/io.h>
+
+#if defined(TRACE_GPIO_PORT) && !defined(TRACE_GPIO_PIN)
+#error "TRACE_GPIO_PIN must be defined along with TRACE_GPIO_PORT"
+#endif
+
+/*
+ * Mask of the events (bit n for event n) that drive the GPIO pin.
+ * The pin is high from the entry to the exit of an event, so nested
+ * events (such as TRACE_TWI_BYTE within TRACE_TWI_TRANSACTION) should
+ * not both be selected.
+ */
+#ifndef TRACE_GPIO_EVENTS
+#define TRACE_GPIO_EVENTS       0xFF
+#endif
+
+#ifdef TRACE_RING_SIZE
+#if TRACE_RING_SIZE < 2 || TRACE_RING_SIZE > 128 || \
+    (TRACE_RING_SIZE & (TRACE_RING_SIZE - 1)) != 0
+#error "TRACE_RING_SIZE must be a power of two from 2 to 128"
+#endif
+#endif
+
+/**
+ * A record in the trace ring.
+ */
+typedef struct {
+    uint16_t time;              /* Timer/Counter1 count */
+    uint8_t event;              /* event, with TRACE_EXIT_FLAG on exit */
+} TraceRecord;
+
+/**
+ * Initializes the trace facility: configures the GPIO pin as an output
+ * and starts Timer/Counter1 for timestamps, as selected at compile time.
+ */
+void trace_init(void);
+
+/**
+ * Records the entry to, or (with TRACE_EXIT_FLAG) the exit from, an event.
+ * This is the out-of-line form of the hooks, for use from assembly.
+ * @param event the event, with TRACE_EXIT_FLAG on exit
+ */
+void trace_event(uint8_t event);
+
+/**
+ * Appends a record to the trace ring, overwriting the oldest record
+ * when the ring is full. May be called from interrupt handlers.
+ * @param event the event, with TRACE_EXIT_FLAG on exit
+ */
+void trace_log(uint8_t event);
+
+/**
+ * Removes the oldest record from the trace ring.
+ * @param record receives the record
+ * @return non-zero if a record was removed; zero if the ring was empty
+ */
+int trace_read(TraceRecord* record);
+
+/**
+ * Removes the records in the trace ring and writes them, oldest first,
+ * one per line, as the timestamp followed by '+' (entry) or '-' (exit)
+ * and the event number; e.g. "51234 +1". Records added while the ring
+ * is dumped are kept for the next dump.
+ * @param puts function that writes a string, such as serial_puts
+ */
+void trace_dump(void (*puts)(const char* s));
+
+static inline void trace_enter(uint8_t event) {
+#ifdef TRACE_GPIO_PORT
+  if (TRACE_GPIO_EVENTS & (1 << event)) {
+    TRACE_GPIO_PORT |= (1 << TRACE_GPIO_PIN);
+  }
+#endif
+#ifdef TRACE_RING_SIZE
+  trace_log(event);
+#endif
+  (void) event;
+}
+
+static inline void trace_exit(uint8_t event) {
+#ifdef TRACE_GPIO_PORT
+  if (TRACE_GPIO_EVENTS & (1 << event)) {
+    TRACE_GPIO_PORT &= ~(1 << TRACE_GPIO_PIN);
+  }
+#endif
+#ifdef TRACE_RING_SIZE
+  trace_log(event | TRACE_EXIT_FLAG);
+#endif
+  (void) event;
+}
+
+#define TRACE_ENTER(event)      trace_enter(event)
+#define TRACE_EXIT(event)       trace_exit(event)
+
+#endif /* __ASSEMBLER__ */
+#endif /* TRACE_H */
@@ -2,10 +2,19 @@
 #include <stdio.h>
 #include <stdarg.h>
 #endif /* SERIAL_PRINTF */
+#include <avr/interrupt.h>
 #include <avr/io.h>
 
+#include "ring.h"
 #include "serial.h"
 
+#ifdef SERIAL_TRACE
+#include "trace.h"
+#else
+#define TRACE_ENTER(event)
+#define TRACE_EXIT(event)
+#endif
+
 #ifndef SERIAL_PRINTF_SIZE
 #define SERIAL_PRINTF_SIZE 128    // buffer size used by serial_printf
 #endif
@@ -14,8 +23,21 @@
 #define SERIAL_BAUD 38400         // works well with common AVR clock sources and speeds
 #endif
 
+#ifndef SERIAL_RX_RING_SIZE
+#define SERIAL_RX_RING_SIZE 16    // power of two; bytes received but not yet read
+#endif
+
 #define SELECTED_UBRR (F_CPU/16/SERIAL_BAUD - 1)
 
+RING_DEFINE(rx_ring, SERIAL_RX_RING_SIZE)
+
+ISR(USART_RX_vect) {
+  TRACE_ENTER(TRACE_SERIAL_RX);
+  uint8_t c = UDR0;
+  rx_ring_push(c);                // dropped if the ring is full
+  TRACE_EXIT(TRACE_SERIAL_RX);
+}
+
 void serial_init(void) {
   UBRR0H = (uint8_t) (SELECTED_UBRR >> 8);
   UBRR0L = (uint8_t) (SELECTED_UBRR & 0xff);
@@ -36,6 +58,14 @@ void serial_puts(const char* s) {
   }
 }
 
+int serial_getc(void) {
+  uint8_t c;
+  if (!rx_ring_pop(&c)) {
+    return -1;
+  }
+  return c;
+}
+
 
 #ifdef SERIAL_PRINTF
 void serial_printf(const char* fmt, ...) {
@@ -0,0 +1,350 @@
+/***************************************************************
+ * C module for using the hardware Two Wire Interface (TWI)
+ * peripheral of AVR microcontrollers such as the ATmega328P as a
+ * bus master, with the same API as the USI TWI master.
+ *
+ * All transfers are driven by the TWI interrupt. The blocking
+ * functions wait for the interrupt-driven transfer to complete,
+ * polling the TWI hardware directly if global interrupts are
+ * disabled.
+ *
+ * @author Carl Harris
+ ***************************************************************/
+
+#include <avr/interrupt.h>
+#include <util/twi.h>
+
+#include "usi_twi_master.h"
+
+#ifdef TWI_TRACE
+#include "trace.h"
+#else
+#define TRACE_ENTER(event)
+#define TRACE_EXIT(event)
+#endif
+
+#ifdef TWCR
+
+#define TWI_BIT_RATE  ((F_CPU / I2C_BUS_HZ - 16) / 2)
+
+#if F_CPU / I2C_BUS_HZ < 16
+#error "I2C_BUS_HZ is too fast for F_CPU"
+#elif TWI_BIT_RATE > 255
+#error "I2C_BUS_HZ is too slow for F_CPU"
+#endif
+
+/*
+ * CPU cycles per iteration of the loops that wait for the peripheral,
+ * counted by instruction as a lower bound, so that the timeout is never
+ * shorter than I2C_STRETCH_TIMEOUT_US.
+ */
+#define TWI_WAIT_LOOP_CYCLES  12
+#define TWI_WAIT_LOOPS \
+    (F_CPU / 1000000UL * I2C_STRETCH_TIMEOUT_US / TWI_WAIT_LOOP_CYCLES)
+
+#if TWI_WAIT_LOOPS > 65535
+#error "I2C_STRETCH_TIMEOUT_US is too long for F_CPU"
+#endif
+
+#define TWCR_NEXT          ((1 << TWINT) | (1 << TWEN) | (1 << TWIE))
+#define TWI_START()        (TWCR = TWCR_NEXT | (1 << TWSTA))
+#define TWI_STOP()         (TWCR = (1 << TWINT) | (1 << TWEN) | (1 << TWSTO))
+#define TWI_RECEIVE_ACK()  (TWCR = TWCR_NEXT | (1 << TWEA))
+#define TWI_RECEIVE_NACK() (TWCR = TWCR_NEXT)
+#define TWI_SEND(b)        {TWDR = (b); TWCR = TWCR_NEXT;}
+
+static const TWIMessage* next_msg;    // messages not yet started
+static size_t msg_count;
+static const TWISegment* next_seg;    // write segments not yet started
+static size_t seg_count;
+
+static uint8_t sla;                   // address byte of current message
+static uint8_t* ptr;                  // next byte to write or read
+static size_t remaining;              // bytes left in the message
+
+static TWIRequest* request;           // interrupt-driven request (or NULL)
+static TWIMessage request_message;    // message for the request
+static volatile bool busy;
+static volatile TWIStatus status;
+static volatile uint8_t progress;     // counts steps of the transfer
+
+/**
+ * Loads the next message to be transferred.
+ * @return true if there was another message
+ */
+static bool next_message(void) {
+  if (msg_count == 0) {
+    return false;
+  }
+  sla = (next_msg->address << 1) | (next_msg->read ? TW_READ : TW_WRITE);
+  ptr = next_msg->data;
+  remaining = next_msg->length;
+  next_msg++;
+  msg_count--;
+  return true;
+}
+
+/**
+ * Loads the next segment of a scatter-gather write.
+ * @return true if there was another segment
+ */
+static bool next_segment(void) {
+  if (seg_count == 0) {
+    return false;
+  }
+  ptr = (uint8_t*) next_seg->data;    // only ever read
+  remaining = next_seg->length;
+  next_seg++;
+  seg_count--;
+  return true;
+}
+
+static void finish(TWIStatus result) {
+  TRACE_EXIT(TRACE_TWI_TRANSACTION);
+  status = result;
+  busy = false;
+  if (request != NULL) {
+    TWIRequest* completed = request;
+    request = NULL;
+    completed->status = result;
+    if (completed->callback) {
+      completed->callback(completed);
+    }
+  }
+}
+
+/**
+ * Generates a repeated start for the next message, or a stop condition
+ * if there are no more messages.
+ */
+static void end_message(void) {
+  if (next_message()) {
+    TWI_START();
+  }
+  else {
+    TWI_STOP();
+    finish(TWI_OK);
+  }
+}
+
+/**
+ * Advances the transfer according to the TWI status code.
+ */
+static void twi_step(void) {
+  progress++;
+  switch (TW_STATUS) {
+    case TW_START:
+    case TW_REP_START:
+      TWI_SEND(sla);
+      break;
+
+    case TW_MT_SLA_ACK:
+    case TW_MT_DATA_ACK:
+      while (remaining == 0 && next_segment()) {
+        ;   // skip empty segments
+      }
+      if (remaining != 0) {
+        remaining--;
+        TWI_SEND(*ptr++);
+      }
+      else {
+        end_message();
+      }
+      break;
+
+    case TW_MR_DATA_ACK:
+      *ptr++ = TWDR;
+      remaining--;
+      // fall through to acknowledge all but the last byte
+    case TW_MR_SLA_ACK:
+      if (remaining > 1) {
+        TWI_RECEIVE_ACK();
+      }
+      else {
+        TWI_RECEIVE_NACK();
+      }
+      break;
+
+    case TW_MR_DATA_NACK:
+      if (remaining != 0) {
+        *ptr++ = TWDR;
+        remaining--;
+      }
+      end_message();
+      break;
+
+    case TW_MT_SLA_NACK:
+    case TW_MR_SLA_NACK:
+      TWI_STOP();
+      finish(TWI_ADDRESS_NACK);
+      break;
+
+    case TW_MT_DATA_NACK:
+      TWI_STOP();
+      finish(TWI_NACK);
+      break;
+
+    case TW_MT_ARB_LOST:
+      TWI_RECEIVE_NACK(); // release the bus
+      finish(TWI_BUS_ERROR);
+      break;
+
+    default:
+      TWI_STOP();
+      finish(TWI_BUS_ERROR);
+      break;
+  }
+}
+
+ISR(TWI_vect) {
+  TRACE_ENTER(TRACE_TWI_BYTE);
+  twi_step();
+  TRACE_EXIT(TRACE_TWI_BYTE);
+}
+
+/**
+ * Disables and re-enables the peripheral, which releases both bus
+ * lines and abandons any transfer in progress.
+ */
+static void reset(void) {
+  TWCR = 0;
+  request = NULL;
+  busy = false;
+  twi_master_init();
+}
+
+/**
+ * Starts a transfer of the given messages, followed by the given
+ * write segments (which continue the last message).
+ * @return true if the transfer was started, false (and the peripheral
+ *    is reset) if a stop condition from the previous transfer did not
+ *    complete within I2C_STRETCH_TIMEOUT_US
+ */
+static bool begin(const TWIMessage* m, size_t m_count,
+    const TWISegment* s, size_t s_count) {
+  // a stop condition from the previous transfer may still be pending
+  uint16_t n = TWI_WAIT_LOOPS;
+  while (TWCR & (1 << TWSTO)) {
+    if (--n == 0) {
+      reset();
+      return false;
+    }
+  }
+  TRACE_ENTER(TRACE_TWI_TRANSACTION);
+  next_msg = m;
+  msg_count = m_count;
+  next_seg = s;
+  seg_count = s_count;
+  busy = true;
+  next_message();
+  TWI_START();
+  return true;
+}
+
+/**
+ * Waits for a transfer to complete, stepping it directly if global
+ * interrupts are disabled. A slave may stretch the clock for up to
+ * I2C_STRETCH_TIMEOUT_US at each step of the transfer.
+ * @return status of the transfer, or TWI_TIMEOUT (and the peripheral
+ *    is reset) if the transfer makes no progress for that long
+ */
+static TWIStatus wait(void) {
+  uint16_t n = TWI_WAIT_LOOPS;
+  uint8_t seen = progress;
+  while (busy) {
+    if (!(SREG & (1 << SREG_I)) && (TWCR & (1 << TWINT))) {
+      twi_step();
+    }
+    if (progress != seen) {
+      seen = progress;
+      n = TWI_WAIT_LOOPS;
+    }
+    else if (--n == 0) {
+      TRACE_EXIT(TRACE_TWI_TRANSACTION);
+      reset();
+      return TWI_TIMEOUT;
+    }
+  }
+  return status;
+}
+
+void twi_master_init(void) {
+  TWSR = 0;           // prescaler 1
+  TWBR = TWI_BIT_RATE;
+  TWCR = (1 << TWEN);
+}
+
+int twi_master_transfer(uint8_t *data, size_t length) {
+  TWIMessage message = {
+      data[0] >> 1, data[0] & TW_READ, data + 1, length - 1 };
+  if (!begin(&message, 1, NULL, 0)) {
+    return 0;
+  }
+  return wait() == TWI_OK;
+}
+
+TWIStatus twi_master_write_read(uint8_t address,
+    const uint8_t* wbuf, size_t wlen, uint8_t* rbuf, size_t rlen) {
+  TWIMessage messages[2] = {
+      { address, false, (uint8_t*) wbuf, wlen },    // only ever read
+      { address, true, rbuf, rlen } };
+  if (!begin(messages, rlen != 0 ? 2 : 1, NULL, 0)) {
+    return TWI_TIMEOUT;
+  }
+  return wait();
+}
+
+TWIStatus twi_master_messages(const TWIMessage* messages, size_t count) {
+  if (count == 0) {
+    return TWI_OK;
+  }
+  if (!begin(messages, count, NULL, 0)) {
+    return TWI_TIMEOUT;
+  }
+  return wait();
+}
+
+TWIStatus twi_master_write_segments(uint8_t address,
+    const TWISegment* segments, size_t count) {
+  TWIMessage message = { address, false, NULL, 0 };
+  if (!begin(&message, 1, segments, count)) {
+    return TWI_TIMEOUT;
+  }
+  return wait();
+}
+
+int twi_master_out(uint8_t address, uint8_t data) {
+  TWIMessage message = { address, false, &data, 1 };
+  if (!begin(&message, 1, NULL, 0)) {
+    return 0;
+  }
+  return wait() == TWI_OK;
+}
+
+TWIStatus twi_master_recover(void) {
+  reset();
+  return TWI_OK;
+}
+
+int twi_master_submit(TWIRequest* req) {
+  if (busy || req->length == 0) {
+    return 0;
+  }
+  req->status = TWI_PENDING;
+  request_message.address = req->data[0] >> 1;
+  request_message.read = req->data[0] & TW_READ;
+  request_message.data = req->data + 1;
+  request_message.length = req->length - 1;
+  request = req;
+  if (!begin(&request_message, 1, NULL, 0)) {
+    req->status = TWI_TIMEOUT;
+    return 0;
+  }
+  return 1;
+}
+
+bool twi_master_busy(void) {
+  return busy;
+}
+
+#endif /* TWCR */
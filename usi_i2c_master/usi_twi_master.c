@@ -15,6 +15,15 @@
 
 #include "usi_twi_master.h"
 
+#ifdef TWI_TRACE
+#include "trace.h"
+#else
+#define TRACE_ENTER(event)
+#define TRACE_EXIT(event)
+#endif
+
+#ifdef USIDR
+
 #define USISR_TRANSFER_8_BIT 		(0b11110000 | (0x00<<USICNT0))
 #define USISR_TRANSFER_1_BIT 		(0b11110000 | (0x0E<<USICNT0))
 #define USICR_CLOCK_STROBE_MASK		0b00101011
@@ -27,16 +36,73 @@
 #define USI_SET_SCL_INPUT() 		(DDR_USI &= ~(1 << PORT_USI_SCL))
 #define USI_SET_SCL_HIGH()			(PORT_USI |=  (1 << PORT_USI_SCL))
 #define USI_SET_SCL_LOW()			  (PORT_USI &= ~(1 << PORT_USI_SCL))
-#define USI_AWAIT_SCL_HIGH()     {while (!(PIN_USI & (1<<PIN_USI_SCL))) {}}
+#define USI_SDA_IS_HIGH()       (PIN_USI & (1 << PIN_USI_SDA))
+
+/*
+ * CPU cycles spent in each half of the bit loop in i2c_do_transfer,
+ * in addition to the delay itself. These are lower bounds counted from
+ * the shortest instruction sequence the loop can compile to: the low
+ * half is the USIOIF test and branch (in, sbrs, rjmp) and the strobe
+ * (out) that raises SCL; the high half is the SCL test (sbic/sbis,
+ * skipping) and the strobe that lowers it. A compiler that emits more
+ * instructions only makes the bus slower, never faster than its mode.
+ */
+#ifndef I2C_LOOP_CYCLES_LOW
+#define I2C_LOOP_CYCLES_LOW   5
+#endif
+#ifndef I2C_LOOP_CYCLES_HIGH
+#define I2C_LOOP_CYCLES_HIGH  3
+#endif
+
+#define I2C_PERIOD_US         (1000000.0 / I2C_BUS_HZ)
+#define I2C_CYCLES_PER_US     (F_CPU / 1000000.0)
+#define I2C_LOOP_US(cycles)   ((cycles) / I2C_CYCLES_PER_US)
+#define I2C_MAX_US(a, b)      ((a) > (b) ? (a) : (b))
+
+/*
+ * SCL high time is delayed for the full specification minimum, so
+ * the loop overhead can only lengthen it. The overhead of both halves
+ * is taken from the low time, which fills the remainder of the period
+ * for the target rate but is never shorter than its own minimum.
+ */
+#define I2C_BIT_HIGH_US       (I2C_THIGH)
+#define I2C_BIT_LOW_US \
+    I2C_MAX_US(I2C_PERIOD_US - I2C_THIGH \
+        - I2C_LOOP_US(I2C_LOOP_CYCLES_LOW + I2C_LOOP_CYCLES_HIGH), \
+        I2C_TLOW - I2C_LOOP_US(I2C_LOOP_CYCLES_LOW))
+
+#define I2C_STRETCH_LOOP_CYCLES   6
+#define I2C_STRETCH_LOOPS \
+    (F_CPU / 1000000UL * I2C_STRETCH_TIMEOUT_US / I2C_STRETCH_LOOP_CYCLES)
+
+#if I2C_STRETCH_LOOPS > 65535
+#error "I2C_STRETCH_TIMEOUT_US is too long for F_CPU"
+#endif
 
 #define USI_I2C_DELAY_HIGH()		(delay_us(I2C_THIGH))
 #define USI_I2C_DELAY_LOW()			(delay_us(I2C_TLOW))
+#define USI_I2C_BIT_DELAY_HIGH()  (delay_us(I2C_BIT_HIGH_US))
+#define USI_I2C_BIT_DELAY_LOW() \
+    (delay_us(I2C_MAX_US(I2C_BIT_LOW_US, 0.0)))
+
+/* set when a slave holds SCL low for longer than the timeout */
+static bool stalled;
 
-typedef enum {
-    ADDRESS,
-    WRITE,
-    READ
-} I2C_State;
+/**
+ * Waits for SCL to go high, allowing a slave to stretch the clock for
+ * up to I2C_STRETCH_TIMEOUT_US.
+ * @return true if SCL is high, false (and stalled is set) on timeout
+ */
+static inline bool i2c_await_scl_high(void) {
+  uint16_t n = I2C_STRETCH_LOOPS;
+  while (!(PIN_USI & (1 << PIN_USI_SCL))) {
+    if (--n == 0) {
+      stalled = true;
+      return false;
+    }
+  }
+  return true;
+}
 
 void twi_master_init(void) {
   DDR_USI  |= (1 << PORT_USI_SDA) | (1 << PORT_USI_SCL);
@@ -57,98 +123,273 @@ void twi_master_init(void) {
 }
 
 static uint8_t i2c_do_transfer(uint8_t usisr_reg) {
+  if (stalled) {
+    return 0xFF;
+  }
+
   USISR = usisr_reg;
   do {
-    USI_I2C_DELAY_LOW();
+    USI_I2C_BIT_DELAY_LOW();
     USI_CLOCK_STROBE();								  // positive Edge
-    USI_AWAIT_SCL_HIGH();
-    USI_I2C_DELAY_HIGH();
+    if (!i2c_await_scl_high()) {
+      return 0xFF;
+    }
+    USI_I2C_BIT_DELAY_HIGH();
     USI_CLOCK_STROBE(); 								// negative Edge
   } while (!(USISR & (1 << USIOIF)));
 
-  USI_I2C_DELAY_LOW();
+  USI_I2C_BIT_DELAY_LOW();
 
   return USIDR;
 }
 
-int twi_master_transfer(uint8_t *data, size_t length) {
-  I2C_State state = ADDRESS;
+/**
+ * Generates a start condition, or a repeated start condition if the
+ * bus is already owned by the master.
+ */
+static void i2c_start(void) {
+  /** release SDA before raising SCL for a repeated start */
+  USIDR = 0xFF;
+  USI_SET_SDA_HIGH();
+  USI_SET_SDA_OUTPUT();
 
-  /** generate start condition */
   USI_SET_SCL_HIGH();
-  USI_AWAIT_SCL_HIGH();
+  if (!i2c_await_scl_high()) {
+    return;
+  }
 
-#ifdef I2C_FAST_MODE
+#if defined(I2C_FAST_MODE) || defined(I2C_FAST_MODE_PLUS)
   USI_I2C_DELAY_HIGH();
 #else
   USI_I2C_DELAY_LOW();
 #endif
 
-  USI_SET_SDA_OUTPUT();
   USI_SET_SCL_OUTPUT();
   USI_SET_SDA_LOW();
   USI_I2C_DELAY_HIGH();
   USI_SET_SCL_LOW();
   USI_I2C_DELAY_LOW();
   USI_SET_SDA_HIGH();
+}
 
-  do {
-    switch (state) {
-      case ADDRESS:
-        if (!(*data & 0x01)) {
-          state = WRITE;
-        }
-        else {
-          state = READ;
-        }
-        //Falls through to WRITE to transmit the address byte
-
-      case WRITE:
-        USI_SET_SCL_LOW();
-        USIDR = *(data);
-        data++;
-        i2c_do_transfer(USISR_TRANSFER_8_BIT);
-        USI_SET_SDA_INPUT();
-        if (i2c_do_transfer(USISR_TRANSFER_1_BIT) & 0x01) {
-          USI_SET_SCL_HIGH();
-          USI_SET_SDA_HIGH();
-          return 0;
-        }
-        USI_SET_SDA_OUTPUT();
-        break;
-
-      case READ:
-        USI_SET_SDA_INPUT();
-        *data = i2c_do_transfer(USISR_TRANSFER_8_BIT);
-        data++;
-        USI_SET_SDA_OUTPUT();
-        if (length == 1) {
-          USIDR = 0xFF;			// NACK
-        }
-        else {
-          USIDR = 0x00;			// ACK
-        }
-        i2c_do_transfer(USISR_TRANSFER_1_BIT);
-        break;
-    }
-
-  } while (--length);
-
+static void i2c_stop(void) {
   USI_SET_SDA_LOW();
   USI_I2C_DELAY_LOW();
   USI_SET_SCL_INPUT();
-  USI_AWAIT_SCL_HIGH();
+  if (!i2c_await_scl_high()) {
+    return;
+  }
 
   USI_I2C_DELAY_HIGH();
   USI_SET_SDA_INPUT();
-  USI_AWAIT_SCL_HIGH();
+}
+
+/**
+ * Attempts to return the bus to the idle state after a timeout by 
+ * clocking SCL (up to nine times) until the slave releases SDA, and 
+ * then generating a stop condition.
+ * @return true if the bus was recovered
+ */
+static bool i2c_recover(void) {
+  stalled = false;
+  USIDR = 0xFF;
+  USI_SET_SDA_HIGH();
+  USI_SET_SDA_OUTPUT();
+  USI_SET_SCL_HIGH();
+  USI_SET_SCL_OUTPUT();
+  if (!i2c_await_scl_high()) {
+    return false;
+  }
+
+  for (uint8_t i = 0; i < 9 && !USI_SDA_IS_HIGH(); i++) {
+    USI_SET_SCL_LOW();
+    USI_I2C_DELAY_LOW();
+    USI_SET_SCL_HIGH();
+    if (!i2c_await_scl_high()) {
+      return false;
+    }
+    USI_I2C_DELAY_HIGH();
+  }
+
+  USI_SET_SCL_LOW();
+  USI_I2C_DELAY_LOW();
+  i2c_stop();
+  return !stalled && USI_SDA_IS_HIGH();
+}
+
+/**
+ * Releases the bus at the end of a transfer.
+ * @param status status of the transfer
+ * @return status of the transfer, or TWI_TIMEOUT if a slave held SCL 
+ *      low for longer than the timeout
+ */
+static TWIStatus i2c_finish(TWIStatus status) {
+  if (!stalled) {
+    i2c_stop();
+  }
+  if (stalled) {
+    i2c_recover();
+    status = TWI_TIMEOUT;
+  }
+  TRACE_EXIT(TRACE_TWI_TRANSACTION);
+  return status;
+}
+
+/**
+ * Writes a byte to the slave.
+ * @param b the byte to write
+ * @return true if the slave acknowledged the byte
+ */
+static bool i2c_write_byte(uint8_t b) {
+  TRACE_ENTER(TRACE_TWI_BYTE);
+  USI_SET_SCL_LOW();
+  USIDR = b;
+  i2c_do_transfer(USISR_TRANSFER_8_BIT);
+  USI_SET_SDA_INPUT();
+  bool ack = !(i2c_do_transfer(USISR_TRANSFER_1_BIT) & 0x01);
+  USI_SET_SDA_OUTPUT();
+  TRACE_EXIT(TRACE_TWI_BYTE);
+  return ack && !stalled;
+}
+
+/**
+ * Reads a byte from the slave.
+ * @param last flag indicating whether this is the last byte to read,
+ *      which the master does not acknowledge
+ * @return the byte that was read
+ */
+static uint8_t i2c_read_byte(bool last) {
+  TRACE_ENTER(TRACE_TWI_BYTE);
+  USI_SET_SDA_INPUT();
+  uint8_t b = i2c_do_transfer(USISR_TRANSFER_8_BIT);
+  USI_SET_SDA_OUTPUT();
+  USIDR = last ? 0xFF : 0x00;     // NACK : ACK
+  i2c_do_transfer(USISR_TRANSFER_1_BIT);
+  TRACE_EXIT(TRACE_TWI_BYTE);
+  return b;
+}
+
+/**
+ * Generates a (repeated) start and addresses a slave.
+ * @param sla address byte (slave address shifted left 1 bit, followed
+ *      by the R/W bit)
+ * @return status of the transfer
+ */
+static TWIStatus i2c_address(uint8_t sla) {
+  i2c_start();
+  if (stalled) {
+    return TWI_TIMEOUT;
+  }
+  return i2c_write_byte(sla) ? TWI_OK : TWI_ADDRESS_NACK;
+}
+
+/**
+ * Writes data to the addressed slave.
+ */
+static TWIStatus i2c_write_data(const uint8_t* data, size_t length) {
+  while (length-- != 0) {
+    if (!i2c_write_byte(*data++)) {
+      return TWI_NACK;
+    }
+  }
+  return TWI_OK;
+}
+
+/**
+ * Generates a (repeated) start and writes the given data to a slave.
+ * The bus is left owned by the master.
+ */
+static TWIStatus i2c_write(uint8_t address, const uint8_t* data,
+    size_t length) {
+  TWIStatus status = i2c_address(address << 1);
+  if (status == TWI_OK) {
+    status = i2c_write_data(data, length);
+  }
+  return status;
+}
+
+/**
+ * Generates a (repeated) start and reads data from a slave into the
+ * given buffer. The bus is left owned by the master.
+ */
+static TWIStatus i2c_read(uint8_t address, uint8_t* data, size_t length) {
+  TWIStatus status = i2c_address((address << 1) | 0x01);
+  if (status != TWI_OK) {
+    return status;
+  }
+  while (length-- != 0 && !stalled) {
+    *data++ = i2c_read_byte(length == 0);
+  }
+  return TWI_OK;
+}
+
+int twi_master_transfer(uint8_t *data, size_t length) {
+  uint8_t address = *data >> 1;
+  TWIStatus status;
+
+  TRACE_ENTER(TRACE_TWI_TRANSACTION);
+  stalled = false;
+  if (*data & 0x01) {
+    status = i2c_read(address, data + 1, length - 1);
+  }
+  else {
+    status = i2c_write(address, data + 1, length - 1);
+  }
+
+  return i2c_finish(status) == TWI_OK;
+}
 
-  return 1;
+TWIStatus twi_master_write_read(uint8_t address,
+    const uint8_t* wbuf, size_t wlen, uint8_t* rbuf, size_t rlen) {
+  TRACE_ENTER(TRACE_TWI_TRANSACTION);
+  stalled = false;
+  TWIStatus status = i2c_write(address, wbuf, wlen);
+  if (status == TWI_OK && rlen != 0) {
+    status = i2c_read(address, rbuf, rlen);
+  }
+  return i2c_finish(status);
+}
+
+TWIStatus twi_master_messages(const TWIMessage* messages, size_t count) {
+  if (count == 0) {
+    return TWI_OK;
+  }
+  TWIStatus status = TWI_OK;
+  TRACE_ENTER(TRACE_TWI_TRANSACTION);
+  stalled = false;
+  while (status == TWI_OK && count-- != 0) {
+    if (messages->read) {
+      status = i2c_read(messages->address, messages->data, messages->length);
+    }
+    else {
+      status = i2c_write(messages->address, messages->data, messages->length);
+    }
+    messages++;
+  }
+  return i2c_finish(status);
+}
+
+TWIStatus twi_master_write_segments(uint8_t address,
+    const TWISegment* segments, size_t count) {
+  TRACE_ENTER(TRACE_TWI_TRANSACTION);
+  stalled = false;
+  TWIStatus status = i2c_address(address << 1);
+  while (status == TWI_OK && count-- != 0) {
+    status = i2c_write_data(segments->data, segments->length);
+    segments++;
+  }
+  return i2c_finish(status);
 }
 
 int twi_master_out(uint8_t address, uint8_t data) {
-  uint8_t buf[2];
-  buf[0] = address << 1;
-  buf[1] = data;
-  return twi_master_transfer(buf, sizeof(buf));
-}
\ No newline at end of file
+  TRACE_ENTER(TRACE_TWI_TRANSACTION);
+  stalled = false;
+  TWIStatus status = i2c_write(address, &data, 1);
+  return i2c_finish(status) == TWI_OK;
+}
+
+TWIStatus twi_master_recover(void) {
+  return i2c_recover() ? TWI_OK : TWI_TIMEOUT;
+}
+
+#endif /* USIDR */
@@ -7,59 +7,93 @@
  * compiler warnings, use a more consistent naming, and generally
  * tidy up.
  *
+ * The same functions are provided for microcontrollers that have a 
+ * TWI peripheral (e.g. ATmega328P) by hw_twi_master.c.
+ *
  * @author Carl Harris
  ***************************************************************/
 
 #ifndef USI_TWI_MASTER_H
 #define USI_TWI_MASTER_H
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <avr/io.h>
 
-#ifdef I2C_FAST_MODE
+#include "usi_twi_pins.h"
+
+#if defined(I2C_FAST_MODE_PLUS)
+//I2C Bus Specification (UM10204) FAST mode plus timing limits
+#define I2C_BUS_HZ	1000000
+#define I2C_TLOW	0.5
+#define I2C_THIGH	0.26
+#elif defined(I2C_FAST_MODE)
 //I2C Bus Specification v2.1 FAST mode timing limits
+#define I2C_BUS_HZ	400000
 #define I2C_TLOW	1.3
 #define I2C_THIGH	0.6
 //I2C Bus Specification v2.1 STANDARD mode timing limits
 #else
+#define I2C_BUS_HZ	100000
 #define I2C_TLOW	4.7
 #define I2C_THIGH	4.0
 #endif
 
-#if defined (__AVR_ATtiny24__) | \
-	defined (__AVR_ATtiny44__) | \
-	defined (__AVR_ATtiny84__)
-#define DDR_USI			DDRA
-#define PORT_USI		PORTA
-#define PIN_USI			PINA
-#define PORT_USI_SDA	PA6
-#define PORT_USI_SCL	PA4
-#define PIN_USI_SDA		PINA6
-#define PIN_USI_SCL		PINA4
+//Longest time (in microseconds) a slave may hold SCL low
+#ifndef I2C_STRETCH_TIMEOUT_US
+#define I2C_STRETCH_TIMEOUT_US	10000
 #endif
 
-#if defined(__AVR_ATtiny85__) || \
-    defined(__AVR_ATtiny45__) || \
-    defined(__AVR_ATtiny25__)
-#define DDR_USI			DDRB
-#define PORT_USI		PORTB
-#define PIN_USI			PINB
-#define PORT_USI_SDA	PB0
-#define PORT_USI_SCL	PB2
-#define PIN_USI_SDA		PINB0
-#define PIN_USI_SCL		PINB2
-#endif
+/**
+ * Status of an interrupt-driven transfer.
+ */
+typedef enum {
+    TWI_PENDING,        /* transfer has not yet completed */
+    TWI_OK,             /* all bytes were transferred */
+    TWI_ADDRESS_NACK,   /* no slave acknowledged the address */
+    TWI_NACK,           /* slave did not acknowledge a data byte */
+    TWI_TIMEOUT,        /* slave held SCL low for too long */
+    TWI_BUS_ERROR       /* bus error or arbitration lost (TWI only) */
+} TWIStatus;
 
-#if defined(__AVR_AT90Tiny2313__) | \
-	defined(__AVR_ATtiny2313__)
-#define DDR_USI             DDRB
-#define PORT_USI            PORTB
-#define PIN_USI             PINB
-#define PORT_USI_SDA        PB5
-#define PORT_USI_SCL        PB7
-#define PIN_USI_SDA         PINB5
-#define PIN_USI_SCL         PINB7
-#endif
+typedef struct TWIRequest TWIRequest;
+
+/**
+ * A user-supplied function that is called (from interrupt context)
+ * when an interrupt-driven transfer completes.
+ * @param request the completed transfer request
+ */
+typedef void (*TWICallback)(TWIRequest* request);
+
+/**
+ * Descriptor for an interrupt-driven transfer. The descriptor and its
+ * data must remain valid until the transfer completes.
+ */
+struct TWIRequest {
+    uint8_t* data;              /* encoded as for twi_master_transfer */
+    size_t length;              /* length of data (including address) */
+    TWICallback callback;       /* completion function (may be NULL) */
+    volatile TWIStatus status;  /* status of the transfer */
+};
+
+/**
+ * A message for a combined transfer. Consecutive messages are
+ * separated by a repeated start condition.
+ */
+typedef struct {
+    uint8_t address;            /* I2C slave address (0x0..0x7f) */
+    bool read;                  /* read from (true) or write to the slave */
+    uint8_t* data;              /* data to write or buffer for data read */
+    size_t length;              /* length of data */
+} TWIMessage;
+
+/**
+ * A segment of data for a scatter-gather write.
+ */
+typedef struct {
+    const uint8_t* data;        /* data to write */
+    size_t length;              /* length of data */
+} TWISegment;
 
 /**
  * Initializes the USI hardware for TWI master operation.
@@ -75,6 +109,44 @@ void twi_master_init(void);
  */
 int twi_master_transfer(uint8_t* data, size_t length);
 
+/**
+ * Writes data to a slave device and then reads data from it, using a
+ * repeated start condition between the write and the read so that 
+ * the bus is not released. This is the usual way to read a register
+ * from a sensor or an EEPROM.
+ * @param address I2C slave address (0x0..0x7f)
+ * @param wbuf the data to write (e.g. a register address)
+ * @param wlen length of the data to write
+ * @param rbuf buffer that will receive the data that is read
+ * @param rlen number of bytes to read (if zero, only the write is done)
+ * @return status of the transfer
+ */
+TWIStatus twi_master_write_read(uint8_t address,
+    const uint8_t* wbuf, size_t wlen, uint8_t* rbuf, size_t rlen);
+
+/**
+ * Performs a combined transfer of several messages, generating a 
+ * repeated start condition between messages and a stop condition after
+ * the last message (or the first message that is not acknowledged).
+ * @param messages the messages to transfer
+ * @param count number of messages
+ * @return status of the transfer
+ */
+TWIStatus twi_master_messages(const TWIMessage* messages, size_t count);
+
+/**
+ * Writes a sequence of data segments to a slave device as a single 
+ * transfer, without copying them into a contiguous buffer. This is 
+ * useful for writing a header (e.g. an EEPROM address or a display 
+ * command) followed by a block of data.
+ * @param address I2C slave address (0x0..0x7f)
+ * @param segments the segments to write, in order
+ * @param count number of segments
+ * @return status of the transfer
+ */
+TWIStatus twi_master_write_segments(uint8_t address,
+    const TWISegment* segments, size_t count);
+
 /**
  * Transfers one byte of data from the master to the slave at the given address.
  * @param address I2C slave address (0x0..0x7f)
@@ -83,4 +155,32 @@ int twi_master_transfer(uint8_t* data, size_t length);
  */
 int twi_master_out(uint8_t address, uint8_t data);
 
+/**
+ * Attempts to return the bus to the idle state by clocking SCL until
+ * a slave releases SDA and then generating a stop condition. This is 
+ * done automatically when a transfer times out.
+ * @return TWI_OK if the bus is idle, otherwise TWI_TIMEOUT
+ */
+TWIStatus twi_master_recover(void);
+
+/**
+ * Starts an interrupt-driven transfer and returns without waiting for
+ * it to complete. Completion is signalled by the status field of the 
+ * request and by its callback function. Requires global interrupts to
+ * be enabled and reserves Timer/Counter0 while the transfer is in 
+ * progress.
+ * @param request descriptor for the transfer
+ * @return 1 if the transfer was started, 0 if a transfer is already
+ *      in progress (or, with hw_twi_master.c, if the stop condition of
+ *      the previous transfer timed out, and the status of the request
+ *      is TWI_TIMEOUT)
+ */
+int twi_master_submit(TWIRequest* request);
+
+/**
+ * Tests whether an interrupt-driven transfer is in progress.
+ * @return true if a transfer is in progress
+ */
+bool twi_master_busy(void);
+
 #endif /* USI_TWI_MASTER */
\ No newline at end of file
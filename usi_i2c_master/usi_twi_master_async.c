@@ -0,0 +1,354 @@
+/***************************************************************
+ * Interrupt-driven (non-blocking) transfers for the Two Wire
+ * Interface (TWI) mode of the Universal Serial Interface (USI).
+ *
+ * The bus clock is generated by a Timer/Counter0 compare match
+ * interrupt, which strobes SCL once per half period. Address, data
+ * and acknowledge phases are sequenced by the USI counter overflow
+ * interrupt, which also completes the transfer and calls the
+ * callback; the timer interrupt calls no functions, so that it
+ * saves only the registers it uses. Timer/Counter0 is reserved for
+ * this module while a transfer is in progress.
+ *
+ * @author Carl Harris
+ ***************************************************************/
+
+#include <avr/interrupt.h>
+
+#include "usi_twi_master.h"
+
+#ifdef TWI_TRACE
+#include "trace.h"
+#else
+#define TRACE_ENTER(event)
+#define TRACE_EXIT(event)
+#endif
+
+#ifdef USIDR
+
+/*
+ * Shortest tick (in CPU cycles) allowed, and the shortest used by
+ * default. Counting the interrupt response, the register saves and
+ * reti, the timer interrupt is estimated to take about 65 cycles for
+ * a clock strobe (the usual tick) and up to about 110 for the tick
+ * that loads the address byte or abandons a stretched transfer. A
+ * tick of 160 cycles leaves the main program about 60% of the CPU.
+ * Check the estimates against the isr_cycles reported for the timer
+ * vector by the benchmark suite (see bench/README.md).
+ */
+#define TWI_ASYNC_MIN_TICK_CYCLES       100
+#define TWI_ASYNC_DEFAULT_TICK_CYCLES   160
+
+// half of the SCL period, in microseconds: 10 us, or longer if needed
+// for the default number of cycles (e.g. 20 us at 8 MHz)
+#ifndef TWI_ASYNC_TICK_US
+#if F_CPU / 1000000UL * 10 >= TWI_ASYNC_DEFAULT_TICK_CYCLES
+#define TWI_ASYNC_TICK_US 10
+#else
+#define TWI_ASYNC_TICK_US \
+    ((TWI_ASYNC_DEFAULT_TICK_CYCLES + F_CPU / 1000000UL - 1) / (F_CPU / 1000000UL))
+#endif
+#endif
+
+#define TWI_ASYNC_TICK_CYCLES (F_CPU / 1000000UL * TWI_ASYNC_TICK_US)
+
+#if TWI_ASYNC_TICK_CYCLES < TWI_ASYNC_MIN_TICK_CYCLES
+#error "TWI_ASYNC_TICK_US is too short for the timer interrupt at this F_CPU"
+#endif
+#if TWI_ASYNC_TICK_CYCLES > 2048
+#error "TWI_ASYNC_TICK_US is too long for Timer/Counter0 at this F_CPU"
+#endif
+#define TWI_STRETCH_TICKS     (I2C_STRETCH_TIMEOUT_US / TWI_ASYNC_TICK_US)
+
+#if TWI_ASYNC_TICK_CYCLES <= 256
+#define TWI_TIMER_PRESCALE    (1 << CS00)
+#define TWI_TIMER_TOP         (TWI_ASYNC_TICK_CYCLES - 1)
+#else
+#define TWI_TIMER_PRESCALE    (1 << CS01)
+#define TWI_TIMER_TOP         (TWI_ASYNC_TICK_CYCLES / 8 - 1)
+#endif
+
+#if defined (__AVR_ATtiny24__) | \
+	defined (__AVR_ATtiny44__) | \
+	defined (__AVR_ATtiny84__)
+#define TWI_TIMSK             TIMSK0
+#define TWI_TIMER_vect        TIM0_COMPA_vect
+#define TWI_USI_OVF_vect      USI_OVF_vect
+#elif defined(__AVR_AT90Tiny2313__) | \
+	defined(__AVR_ATtiny2313__)
+#define TWI_TIMSK             TIMSK
+#define TWI_TIMER_vect        TIMER0_COMPA_vect
+#define TWI_USI_OVF_vect      USI_OVERFLOW_vect
+#else
+#define TWI_TIMSK             TIMSK
+#define TWI_TIMER_vect        TIMER0_COMPA_vect
+#define TWI_USI_OVF_vect      USI_OVF_vect
+#endif
+
+#define USISR_TRANSFER_8_BIT 		(0b11110000 | (0x00<<USICNT0))
+#define USISR_TRANSFER_1_BIT 		(0b11110000 | (0x0E<<USICNT0))
+#define USISR_TRANSFER_STROBE   (0b11110000 | (0x0F<<USICNT0))
+#define USISR_CLEAR_FLAGS       0b11110000
+#define USICR_SYNC_MASK         0b00101010
+#define USICR_ASYNC_MASK        (USICR_SYNC_MASK | (1 << USIOIE))
+#define USICR_SOFTWARE_STROBE   ((1 << USIOIE) | (1 << USIWM1) | (1 << USICLK))
+#define USI_CLOCK_STROBE()      (USICR = USICR_ASYNC_MASK | (1 << USITC))
+#define USI_SET_SDA_OUTPUT()		(DDR_USI |=  (1 << PORT_USI_SDA))
+#define USI_SET_SDA_INPUT() 		(DDR_USI &= ~(1 << PORT_USI_SDA))
+#define USI_SET_SDA_HIGH()			(PORT_USI |=  (1 << PORT_USI_SDA))
+#define USI_SET_SDA_LOW()			  (PORT_USI &= ~(1 << PORT_USI_SDA))
+#define USI_SET_SCL_OUTPUT()		(DDR_USI |=  (1 << PORT_USI_SCL))
+#define USI_SET_SCL_HIGH()			(PORT_USI |=  (1 << PORT_USI_SCL))
+#define USI_SET_SCL_LOW()			  (PORT_USI &= ~(1 << PORT_USI_SCL))
+#define USI_SCL_RELEASED()      (PORT_USI & (1 << PORT_USI_SCL))
+#define USI_SCL_IS_HIGH()       (PIN_USI & (1 << PIN_USI_SCL))
+
+typedef enum {
+    BUS_START,
+    BUS_CLOCK,
+    BUS_STOP
+} BusState;
+
+typedef enum {
+    DATA_OUT,
+    ACK_IN,
+    DATA_IN,
+    ACK_OUT,
+    COMPLETE
+} TransferState;
+
+static TWIRequest* volatile current;
+static uint8_t* data;
+static size_t remaining;
+static bool reading;
+static uint16_t stretched;
+static uint8_t step;
+static BusState bus_state;
+static TransferState transfer_state;
+
+static void timer_start(void) {
+  TCNT0 = 0;
+  OCR0A = TWI_TIMER_TOP;
+  TCCR0A = (1 << WGM01);
+  TCCR0B = TWI_TIMER_PRESCALE;
+  TWI_TIMSK |= (1 << OCIE0A);
+}
+
+static void timer_stop(void) {
+  TWI_TIMSK &= ~(1 << OCIE0A);
+  TCCR0B = 0;
+}
+
+static void begin_stop(TWIStatus status) {
+  current->status = status;
+  USIDR = 0xFF;                       // release the output latch for SDA
+  USISR = USISR_CLEAR_FLAGS;
+  bus_state = BUS_STOP;
+  stretched = 0;
+  step = 0;
+}
+
+/*
+ * Abandons the transfer after a slave held SCL low for too long,
+ * continuing with the last step of the stop condition to release SDA.
+ * Use twi_master_recover to clock the bus back to the idle state.
+ */
+static void time_out(void) {
+  current->status = TWI_TIMEOUT;
+  USIDR = 0xFF;
+  bus_state = BUS_STOP;
+  step = 2;
+}
+
+/*
+ * Ends the transfer from the timer interrupt. The timer is stopped,
+ * and a software clock strobe (with the USI counter one count short
+ * of overflow) raises the USI overflow interrupt, which completes the
+ * transfer as soon as the timer interrupt returns.
+ */
+static void end_transfer(void) {
+  timer_stop();
+  transfer_state = COMPLETE;
+  USISR = USISR_TRANSFER_STROBE;
+  USICR = USICR_SOFTWARE_STROBE;
+}
+
+static void complete(void) {
+  TWIRequest* request = current;
+  TRACE_EXIT(TRACE_TWI_TRANSACTION);
+  USISR = USISR_CLEAR_FLAGS;
+  USICR = USICR_SYNC_MASK;
+  current = NULL;
+  if (request->callback) {
+    request->callback(request);
+  }
+}
+
+/*
+ * Generates a start condition and loads the address byte, one step
+ * per timer tick.
+ */
+static void start_tick(void) {
+  switch (step) {
+    case 0:
+      USI_SET_SCL_HIGH();
+      USI_SET_SDA_HIGH();
+      USI_SET_SCL_OUTPUT();
+      USI_SET_SDA_OUTPUT();
+      step++;
+      break;
+
+    case 1:
+      USI_SET_SDA_LOW();
+      step++;
+      break;
+
+    default:
+      USI_SET_SCL_LOW();
+      reading = *data & 0x01;
+      USIDR = *data++;
+      remaining--;
+      USI_SET_SDA_HIGH();
+      USISR = USISR_TRANSFER_8_BIT;
+      transfer_state = DATA_OUT;
+      bus_state = BUS_CLOCK;
+      break;
+  }
+}
+
+/*
+ * Generates a stop condition, one step per timer tick.
+ */
+static void stop_tick(void) {
+  switch (step) {
+    case 0:
+      USI_SET_SDA_LOW();
+      USI_SET_SDA_OUTPUT();
+      step++;
+      break;
+
+    case 1:
+      USI_SET_SCL_HIGH();
+      step++;
+      break;
+
+    default:
+      USI_SET_SDA_HIGH();
+      end_transfer();
+      break;
+  }
+}
+
+/*
+ * Each function called here has this as its only caller, so it is
+ * inlined and the handler makes no calls.
+ */
+ISR(TWI_TIMER_vect) {
+  if (USI_SCL_RELEASED() && !USI_SCL_IS_HIGH()) {
+    // a slave is stretching the clock
+    if (++stretched <= TWI_STRETCH_TICKS) {
+      return;
+    }
+    time_out();
+  }
+  else if (stretched) {
+    // hold SCL high for a whole tick after the slave releases it
+    stretched = 0;
+    return;
+  }
+
+  switch (bus_state) {
+    case BUS_CLOCK:
+      USI_CLOCK_STROBE();
+      break;
+    case BUS_START:
+      start_tick();
+      break;
+    case BUS_STOP:
+      stop_tick();
+      break;
+  }
+}
+
+ISR(TWI_USI_OVF_vect) {
+  TRACE_ENTER(TRACE_TWI_BYTE);
+  switch (transfer_state) {
+    case DATA_OUT:
+      USI_SET_SDA_INPUT();
+      USISR = USISR_TRANSFER_1_BIT;
+      transfer_state = ACK_IN;
+      break;
+
+    case ACK_IN:
+      USI_SET_SDA_OUTPUT();
+      if (USIDR & 0x01) {
+        // only the address byte has been sent if data is just past it
+        begin_stop(data == current->data + 1 ? TWI_ADDRESS_NACK : TWI_NACK);
+      }
+      else if (remaining == 0) {
+        begin_stop(TWI_OK);
+      }
+      else if (reading) {
+        USI_SET_SDA_INPUT();
+        USISR = USISR_TRANSFER_8_BIT;
+        transfer_state = DATA_IN;
+      }
+      else {
+        USIDR = *data++;
+        remaining--;
+        USISR = USISR_TRANSFER_8_BIT;
+        transfer_state = DATA_OUT;
+      }
+      break;
+
+    case DATA_IN:
+      *data++ = USIDR;
+      remaining--;
+      USI_SET_SDA_OUTPUT();
+      USIDR = remaining == 0 ? 0xFF : 0x00;   // NACK the last byte
+      USISR = USISR_TRANSFER_1_BIT;
+      transfer_state = ACK_OUT;
+      break;
+
+    case ACK_OUT:
+      if (remaining == 0) {
+        begin_stop(TWI_OK);
+      }
+      else {
+        USI_SET_SDA_INPUT();
+        USISR = USISR_TRANSFER_8_BIT;
+        transfer_state = DATA_IN;
+      }
+      break;
+
+    case COMPLETE:
+      complete();
+      break;
+  }
+  TRACE_EXIT(TRACE_TWI_BYTE);
+}
+
+int twi_master_submit(TWIRequest* request) {
+  if (current != NULL || request->length == 0) {
+    return 0;
+  }
+
+  request->status = TWI_PENDING;
+  data = request->data;
+  remaining = request->length;
+  stretched = 0;
+  step = 0;
+  bus_state = BUS_START;
+  current = request;
+
+  TRACE_ENTER(TRACE_TWI_TRANSACTION);
+  USICR = USICR_ASYNC_MASK;
+  timer_start();
+  return 1;
+}
+
+bool twi_master_busy(void) {
+  return current != NULL;
+}
+
+#endif /* USIDR */
@@ -0,0 +1,52 @@
+/***************************************************************
+ * Port and pin assignments of the Universal Serial Interface
+ * (USI) in two-wire mode, for the microcontrollers supported by
+ * the USI TWI master and slave modules. Define DDR_USI and the
+ * rest in your build to use another microcontroller.
+ *
+ * @author Carl Harris
+ ***************************************************************/
+
+#ifndef USI_TWI_PINS_H
+#define USI_TWI_PINS_H
+
+#include <avr/io.h>
+
+#ifndef DDR_USI
+#if defined (__AVR_ATtiny24__) | \
+	defined (__AVR_ATtiny44__) | \
+	defined (__AVR_ATtiny84__)
+#define DDR_USI			DDRA
+#define PORT_USI		PORTA
+#define PIN_USI			PINA
+#define PORT_USI_SDA	PA6
+#define PORT_USI_SCL	PA4
+#define PIN_USI_SDA		PINA6
+#define PIN_USI_SCL		PINA4
+#endif
+
+#if defined(__AVR_ATtiny85__) || \
+    defined(__AVR_ATtiny45__) || \
+    defined(__AVR_ATtiny25__)
+#define DDR_USI			DDRB
+#define PORT_USI		PORTB
+#define PIN_USI			PINB
+#define PORT_USI_SDA	PB0
+#define PORT_USI_SCL	PB2
+#define PIN_USI_SDA		PINB0
+#define PIN_USI_SCL		PINB2
+#endif
+
+#if defined(__AVR_AT90Tiny2313__) | \
+	defined(__AVR_ATtiny2313__)
+#define DDR_USI             DDRB
+#define PORT_USI            PORTB
+#define PIN_USI             PINB
+#define PORT_USI_SDA        PB5
+#define PORT_USI_SCL        PB7
+#define PIN_USI_SDA         PINB5
+#define PIN_USI_SCL         PINB7
+#endif
+#endif /* DDR_USI */
+
+#endif /* USI_TWI_PINS_H */
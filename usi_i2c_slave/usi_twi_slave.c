@@ -0,0 +1,194 @@
+/***************************************************************
+ * C module for using the Two Wire Interface (TWI) mode of the
+ * Universal Serial Interface (USI) in AVR microcontrollers such
+ * as the ATtiny85 as an interrupt-driven I2C slave, exposing a
+ * register map to the bus master.
+ *
+ * Follows the state machine described in Atmel application note
+ * AVR312. The USI start condition interrupt begins each transfer
+ * and the USI counter overflow interrupt handles each address,
+ * data and acknowledge phase. The USI holds SCL low from each
+ * counter overflow until the next phase has been set up, so the
+ * interrupt handlers do as little as possible.
+ *
+ * @author Carl Harris
+ ***************************************************************/
+
+#include <stdbool.h>
+#include <avr/interrupt.h>
+
+#include "usi_twi_slave.h"
+
+#if defined (__AVR_ATtiny24__) | \
+	defined (__AVR_ATtiny44__) | \
+	defined (__AVR_ATtiny84__)
+#define TWI_USI_START_vect    USI_STR_vect
+#define TWI_USI_OVF_vect      USI_OVF_vect
+#elif defined(__AVR_AT90Tiny2313__) | \
+	defined(__AVR_ATtiny2313__)
+#define TWI_USI_START_vect    USI_START_vect
+#define TWI_USI_OVF_vect      USI_OVERFLOW_vect
+#else
+#define TWI_USI_START_vect    USI_START_vect
+#define TWI_USI_OVF_vect      USI_OVF_vect
+#endif
+
+/* wait for a start condition; SCL is not held on counter overflow */
+#define USICR_START_MODE    ((1 << USISIE) | (0 << USIOIE) \
+                            | (1 << USIWM1) | (0 << USIWM0) \
+                            | (1 << USICS1) | (0 << USICS0) | (0 << USICLK))
+/* transfer in progress; SCL is held low on counter overflow */
+#define USICR_TRANSFER_MODE ((1 << USISIE) | (1 << USIOIE) \
+                            | (1 << USIWM1) | (1 << USIWM0) \
+                            | (1 << USICS1) | (0 << USICS0) | (0 << USICLK))
+
+/* clears all flags except the start condition flag */
+#define USISR_CLEAR           ((1 << USIOIF) | (1 << USIPF) | (1 << USIDC))
+#define USISR_TRANSFER_8_BIT  (USISR_CLEAR | (0x00 << USICNT0))
+#define USISR_TRANSFER_1_BIT  (USISR_CLEAR | (0x0E << USICNT0))
+
+#define USI_SET_SDA_OUTPUT()  (DDR_USI |=  (1 << PORT_USI_SDA))
+#define USI_SET_SDA_INPUT()   (DDR_USI &= ~(1 << PORT_USI_SDA))
+#define USI_SCL_IS_HIGH()     (PIN_USI & (1 << PIN_USI_SCL))
+#define USI_SDA_IS_HIGH()     (PIN_USI & (1 << PIN_USI_SDA))
+
+typedef enum {
+    CHECK_ADDRESS,
+    SEND_DATA,
+    REQUEST_REPLY,
+    CHECK_REPLY,
+    REQUEST_DATA,
+    GET_DATA
+} SlaveState;
+
+static const TWISlaveMap* map;
+static uint8_t slave_address;
+static uint8_t slave_mask;
+static uint8_t pointer;
+static bool pointer_next;         // next byte written sets the pointer
+static SlaveState state;
+
+static void await_start(void) {
+  USI_SET_SDA_INPUT();
+  USICR = USICR_START_MODE;
+  USISR = USISR_CLEAR;
+}
+
+static void send_ack(void) {
+  USIDR = 0;
+  USI_SET_SDA_OUTPUT();
+  USISR = USISR_TRANSFER_1_BIT;
+}
+
+static void advance_pointer(void) {
+  if (++pointer >= map->size) {
+    pointer = 0;
+  }
+}
+
+ISR(TWI_USI_START_vect) {
+  state = CHECK_ADDRESS;
+  USI_SET_SDA_INPUT();
+
+  // wait for the master to complete the start condition (SCL low),
+  // or to follow it with a stop condition (SDA high)
+  while (USI_SCL_IS_HIGH() && !USI_SDA_IS_HIGH()) {
+    ;
+  }
+
+  USICR = USI_SDA_IS_HIGH() ? USICR_START_MODE : USICR_TRANSFER_MODE;
+  USISR = (1 << USISIF) | USISR_CLEAR;    // releases SCL
+}
+
+ISR(TWI_USI_OVF_vect) {
+  switch (state) {
+    case CHECK_ADDRESS: {
+      uint8_t sla = USIDR;
+      if (((sla >> 1) ^ slave_address) & slave_mask) {
+        await_start();
+        break;
+      }
+      if (sla & 0x01) {
+        state = SEND_DATA;
+      }
+      else {
+        state = REQUEST_DATA;
+        pointer_next = true;
+      }
+      send_ack();
+      break;
+    }
+
+    case CHECK_REPLY:
+      if (USIDR) {
+        // master did not acknowledge; it wants no more data
+        await_start();
+        break;
+      }
+      // fall through to send the next register
+
+    case SEND_DATA:
+      if (map->on_read) {
+        map->on_read(pointer);
+      }
+      USIDR = map->registers[pointer];
+      advance_pointer();
+      USI_SET_SDA_OUTPUT();
+      USISR = USISR_TRANSFER_8_BIT;
+      state = REQUEST_REPLY;
+      break;
+
+    case REQUEST_REPLY:
+      USIDR = 0;
+      USI_SET_SDA_INPUT();
+      USISR = USISR_TRANSFER_1_BIT;
+      state = CHECK_REPLY;
+      break;
+
+    case REQUEST_DATA:
+      USI_SET_SDA_INPUT();
+      USISR = USISR_TRANSFER_8_BIT;
+      state = GET_DATA;
+      break;
+
+    case GET_DATA: {
+      uint8_t value = USIDR;
+      // acknowledge first, so that SCL is released before the callback
+      state = REQUEST_DATA;
+      send_ack();
+      if (pointer_next) {
+        pointer = value < map->size ? value : 0;
+        pointer_next = false;
+      }
+      else {
+        uint8_t reg = pointer;
+        map->registers[reg] = value;
+        advance_pointer();
+        if (map->on_write) {
+          map->on_write(reg, value);
+        }
+      }
+      break;
+    }
+  }
+}
+
+void twi_slave_init(uint8_t address, uint8_t mask, const TWISlaveMap* m) {
+  map = m;
+  slave_address = address & mask;
+  slave_mask = mask & 0x7f;
+  pointer = 0;
+
+  // SCL is an output so that the USI can hold it low
+  PORT_USI |= (1 << PORT_USI_SCL) | (1 << PORT_USI_SDA);
+  DDR_USI |= (1 << PORT_USI_SCL);
+  USI_SET_SDA_INPUT();
+
+  USICR = USICR_START_MODE;
+  USISR = (1 << USISIF) | USISR_CLEAR;
+}
+
+void twi_slave_disable(void) {
+  USICR = 0;
+  DDR_USI &= ~((1 << PORT_USI_SCL) | (1 << PORT_USI_SDA));
+}
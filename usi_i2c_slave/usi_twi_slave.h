@@ -0,0 +1,62 @@
+/***************************************************************
+ * C module for using the Two Wire Interface (TWI) mode of the
+ * Universal Serial Interface (USI) in AVR microcontrollers such
+ * as the ATtiny85 as an interrupt-driven I2C slave, exposing a
+ * register map to the bus master.
+ *
+ * @author Carl Harris
+ ***************************************************************/
+
+#ifndef USI_TWI_SLAVE_H
+#define USI_TWI_SLAVE_H
+
+#include <stdint.h>
+#include <avr/io.h>
+
+#include "usi_twi_pins.h"
+
+/**
+ * Register map exposed to the bus master.
+ *
+ * A write transfer from the master sets the register pointer from the
+ * first data byte; any further bytes are written to the registers 
+ * starting at the pointer. A read transfer returns the registers 
+ * starting at the pointer. The pointer is incremented after each 
+ * register that is read or written, wrapping to zero after the last
+ * register, so a register can be read by writing its index and then 
+ * reading (usually after a repeated start).
+ *
+ * The callbacks are invoked from interrupt context, so they must be
+ * short. on_read runs while SCL is held low, before the register is
+ * loaded for transmission, so it stretches the clock for as long as it
+ * runs. on_write runs after the acknowledge has released SCL, so it
+ * stretches the clock only if it is still running when the next byte
+ * has been received.
+ */
+typedef struct {
+    volatile uint8_t* registers;    /* register file */
+    uint8_t size;                   /* number of registers */
+    /* called after a register is written by the master (may be NULL) */
+    void (*on_write)(uint8_t reg, uint8_t value);
+    /* called before a register is sent to the master (may be NULL) */
+    void (*on_read)(uint8_t reg);
+} TWISlaveMap;
+
+/**
+ * Initializes the USI hardware for TWI slave operation. Requires global
+ * interrupts to be enabled.
+ * @param address I2C slave address (0x0..0x7f)
+ * @param mask bits of the address that must match; use 0x7f to respond
+ *      only to the given address, or clear low-order bits to respond to
+ *      a range of addresses
+ * @param map register map to expose; must remain valid while the slave
+ *      is enabled
+ */
+void twi_slave_init(uint8_t address, uint8_t mask, const TWISlaveMap* map);
+
+/**
+ * Disables TWI slave operation, releasing the bus lines.
+ */
+void twi_slave_disable(void);
+
+#endif /* USI_TWI_SLAVE_H */